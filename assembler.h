@@ -0,0 +1,528 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "disasm.h"
+
+// Two-pass 8080 assembler writing straight into a memory image.
+//
+//	label:	MNEMONIC operand, operand	; comment
+//	NAME	EQU expression
+//			ORG expression
+//			DB	expression | 'string', ...
+//			DW	expression, ...
+//
+// Expressions : decimal, 0x1F / 1FH / $1F hex, 0b101 / 101B binary, 'c' characters, labels,
+// $ (address of the current line), + - * / % & | ^ << >> ~ and parentheses.
+
+struct AssemblyResult {
+	bool ok = true;
+	std::vector<std::string> errors;					// "line N: message"
+	std::map<std::string, uint16_t> labels;
+	std::vector<std::pair<uint16_t, uint32_t>> segments;	// [start, end) written by each ORG block
+};
+
+class Assembler {
+public:
+	AssemblyResult assemble(const std::string& source, uint8_t* memory, size_t memorySize, uint16_t origin = 0){
+		this->memory = memory;
+		this->memorySize = memorySize;
+		result = AssemblyResult();
+		splitLines(source);
+
+		// Pass 1 sizes every line and assigns labels, pass 2 evaluates and emits
+		for(pass = 1; pass <= 2; pass++){
+			address = origin;
+			segmentStart = origin;
+			for(lineNumber = 0; lineNumber < lines.size(); lineNumber++)
+				assembleLine(lines[lineNumber]);
+			closeSegment();
+			if(!result.ok)
+				break;
+		}
+		return result;
+	}
+
+private:
+	uint8_t* memory = nullptr;
+	size_t memorySize = 0;
+	AssemblyResult result;
+	std::vector<std::string> lines;
+	size_t lineNumber = 0;
+	int pass = 1;
+	uint32_t address = 0;
+	uint32_t lineAddress = 0;
+	uint32_t segmentStart = 0;
+
+	// Expression cursor
+	std::string text;
+	size_t position = 0;
+	bool unresolved = false;
+
+	void splitLines(const std::string& source){
+		lines.clear();
+		std::string line;
+		for(char c : source){
+			if(c == '\n'){
+				lines.push_back(line);
+				line.clear();
+			} else if(c != '\r'){
+				line += c;
+			}
+		}
+		lines.push_back(line);
+	}
+
+	void error(const std::string& message){
+		result.ok = false;
+		result.errors.push_back("line " + std::to_string(lineNumber + 1) + ": " + message);
+	}
+
+	void closeSegment(){
+		if(pass == 2 && address > segmentStart)
+			result.segments.push_back({static_cast<uint16_t>(segmentStart), static_cast<uint32_t>(std::min<size_t>(address, memorySize))});
+	}
+
+	void emit(uint8_t d8){
+		if(pass == 2){
+			if(address < memorySize)
+				memory[address] = d8;
+			else
+				error("address out of memory");
+		}
+		address++;
+	}
+
+	void emit16(uint16_t d16){
+		emit(d16 & 0xFF);
+		emit(d16 >> 8);
+	}
+
+	static std::string upper(std::string word){
+		for(char& c : word)
+			c = std::toupper(static_cast<unsigned char>(c));
+		return word;
+	}
+
+	static std::string trim(const std::string& word){
+		size_t first = word.find_first_not_of(" \t");
+		if(first == std::string::npos)
+			return "";
+		size_t last = word.find_last_not_of(" \t");
+		return word.substr(first, last - first + 1);
+	}
+
+	static bool isIdentifierStart(char c){
+		return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '?' || c == '@';
+	}
+	static bool isIdentifierChar(char c){
+		return isIdentifierStart(c) || std::isdigit(static_cast<unsigned char>(c));
+	}
+
+	static bool isRegisterName(const std::string& word){
+		static const char* names[] = {"A", "B", "C", "D", "E", "H", "L", "M", "SP", "PSW"};
+		std::string name = upper(word);
+		for(const char* candidate : names)
+			if(name == candidate)
+				return true;
+		return false;
+	}
+
+	// Strips the comment, keeping ';' inside quotes
+	static std::string stripComment(const std::string& line){
+		char quote = 0;
+		for(size_t i = 0; i < line.size(); i++){
+			if(quote){
+				if(line[i] == quote)
+					quote = 0;
+			} else if(line[i] == '\'' || line[i] == '"'){
+				quote = line[i];
+			} else if(line[i] == ';'){
+				return line.substr(0, i);
+			}
+		}
+		return line;
+	}
+
+	// Splits operands on commas outside quotes
+	static std::vector<std::string> splitOperands(const std::string& operands){
+		std::vector<std::string> parts;
+		std::string part;
+		char quote = 0;
+		for(char c : operands){
+			if(quote){
+				if(c == quote)
+					quote = 0;
+			} else if(c == '\'' || c == '"'){
+				quote = c;
+			} else if(c == ','){
+				parts.push_back(trim(part));
+				part.clear();
+				continue;
+			}
+			part += c;
+		}
+		if(!trim(part).empty() || !parts.empty())
+			parts.push_back(trim(part));
+		return parts;
+	}
+
+	void defineLabel(const std::string& name, uint16_t value){
+		if(pass == 1){
+			if(result.labels.count(name))
+				error("duplicate label '" + name + "'");
+			result.labels[name] = value;
+		}
+	}
+
+	void assembleLine(const std::string& rawLine){
+		std::string line = trim(stripComment(rawLine));
+		lineAddress = address;
+		if(line.empty())
+			return;
+
+		// Leading identifier : label with ':' or NAME EQU value
+		size_t end = 0;
+		while(end < line.size() && isIdentifierChar(line[end]))
+			end++;
+		if(end > 0 && isIdentifierStart(line[0])){
+			std::string name = line.substr(0, end);
+			std::string rest = trim(line.substr(end));
+			if(!rest.empty() && rest[0] == ':'){
+				rest = trim(rest.substr(1));
+				std::string next = upper(rest.substr(0, 3));
+				if(!(next == "EQU" && (rest.size() == 3 || !isIdentifierChar(rest[3])))){
+					defineLabel(name, lineAddress);
+					line = rest;
+				} else {
+					line = name + " " + rest;
+				}
+			}
+			if(line.empty())
+				return;
+		}
+
+		// Mnemonic and operands
+		end = 0;
+		while(end < line.size() && !std::isspace(static_cast<unsigned char>(line[end])))
+			end++;
+		std::string mnemonic = upper(line.substr(0, end));
+		std::string operandText = trim(line.substr(end));
+
+		// NAME EQU expression
+		size_t split = 0;
+		while(split < operandText.size() && !std::isspace(static_cast<unsigned char>(operandText[split])))
+			split++;
+		if(upper(operandText.substr(0, split)) == "EQU"){
+			int64_t value = evaluate(trim(operandText.substr(split)));
+			if(pass == 1 && unresolved)
+				error("EQU value must be known in the first pass");
+			defineLabel(line.substr(0, end), static_cast<uint16_t>(value));
+			return;
+		}
+
+		std::vector<std::string> operands = splitOperands(operandText);
+		if(mnemonic == "ORG"){
+			if(operands.size() != 1)
+				return error("ORG takes one operand");
+			int64_t value = evaluate(operands[0]);
+			if(unresolved)
+				return error("ORG address must be known in the first pass");
+			if(value < 0 || value > 0xFFFF)
+				return error("value out of range");
+			closeSegment();
+			address = segmentStart = static_cast<uint16_t>(value);
+			return;
+		}
+		if(mnemonic == "DB"){
+			for(const std::string& operand : operands){
+				if(operand.size() >= 2 && (operand[0] == '"' || (operand[0] == '\'' && operand.size() > 3)) && operand.back() == operand[0]){
+					for(size_t i = 1; i + 1 < operand.size(); i++)
+						emit(static_cast<uint8_t>(operand[i]));
+				} else {
+					emit(evaluate8(operand));
+				}
+			}
+			return;
+		}
+		if(mnemonic == "DW"){
+			for(const std::string& operand : operands)
+				emit16(evaluate16(operand));
+			return;
+		}
+		assembleInstruction(mnemonic, operands);
+	}
+
+	void assembleInstruction(const std::string& mnemonic, const std::vector<std::string>& operands){
+		if(mnemonic == "RST"){
+			if(operands.size() != 1)
+				return error("RST takes one operand");
+			int64_t vector = evaluate(operands[0]);
+			if(!unresolved && (vector < 0 || vector > 7))
+				return error("RST vector must be 0 to 7");
+			emit(0xC7 | ((vector & 0x7) << 3));
+			return;
+		}
+
+		// Leading register operands are part of the opcode, what follows is the immediate
+		std::string key = mnemonic;
+		size_t registers = 0;
+		while(registers < operands.size() && isRegisterName(operands[registers])){
+			key += (registers == 0 ? " " : ",") + upper(operands[registers]);
+			registers++;
+		}
+
+		int opcode = findOpcode(key);
+		if(opcode < 0)
+			return error("unknown instruction '" + trim(key) + "'");
+
+		const OpcodeInfo& info = opcodeTable[opcode];
+		size_t expected = registers + (info.length > 1 ? 1 : 0);
+		if(operands.size() != expected)
+			return error("wrong operand count for '" + mnemonic + "'");
+
+		emit(static_cast<uint8_t>(opcode));
+		if(info.length == 2)
+			emit(evaluate8(operands[registers]));
+		else if(info.length == 3)
+			emit16(evaluate16(operands[registers]));
+	}
+
+	// Looks the mnemonic up in opcodeTable, immediate placeholders stripped ("MVI B, " -> "MVI B")
+	static int findOpcode(const std::string& key){
+		static std::map<std::string, int> opcodes;
+		if(opcodes.empty()){
+			for(int opcode = 0; opcode < 256; opcode++){
+				if(opcodeTable[opcode].flow == FLOW_INVALID)
+					continue;
+				std::string name = opcodeTable[opcode].mnemonic;
+				while(!name.empty() && (name.back() == ' ' || name.back() == ','))
+					name.pop_back();
+				opcodes.emplace(name, opcode);
+			}
+		}
+		auto found = opcodes.find(key);
+		return found == opcodes.end() ? -1 : found->second;
+	}
+
+	// Expression evaluation, recursive descent from lowest to highest precedence.
+	// Unknown labels evaluate to 0 in the first pass and are an error in the second.
+	int64_t evaluate(const std::string& expression){
+		text = expression;
+		position = 0;
+		unresolved = false;
+		int64_t value = parseOr();
+		skipSpaces();
+		if(position != text.size())
+			error("unexpected '" + text.substr(position) + "' in expression");
+		return value;
+	}
+
+	// Operands of DB and d8 (-128..255) or DW, a16 and d16 (-32768..65535), negative values
+	// are stored in two's complement
+	uint8_t evaluate8(const std::string& expression){
+		int64_t value = evaluate(expression);
+		if(!unresolved && (value < -0x80 || value > 0xFF))
+			error("value out of range");
+		return static_cast<uint8_t>(value);
+	}
+	uint16_t evaluate16(const std::string& expression){
+		int64_t value = evaluate(expression);
+		if(!unresolved && (value < -0x8000 || value > 0xFFFF))
+			error("value out of range");
+		return static_cast<uint16_t>(value);
+	}
+
+	void skipSpaces(){
+		while(position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+			position++;
+	}
+
+	bool accept(const char* token){
+		skipSpaces();
+		size_t length = std::char_traits<char>::length(token);
+		if(text.compare(position, length, token) == 0){
+			// keep '<' from matching the first half of '<<'
+			if(length == 1 && position + 1 < text.size() && (token[0] == '<' || token[0] == '>') && text[position + 1] == token[0])
+				return false;
+			position += length;
+			return true;
+		}
+		return false;
+	}
+
+	int64_t parseOr(){
+		int64_t value = parseXor();
+		while(accept("|"))
+			value |= parseXor();
+		return value;
+	}
+	int64_t parseXor(){
+		int64_t value = parseAnd();
+		while(accept("^"))
+			value ^= parseAnd();
+		return value;
+	}
+	int64_t parseAnd(){
+		int64_t value = parseShift();
+		while(accept("&"))
+			value &= parseShift();
+		return value;
+	}
+	int64_t parseShift(){
+		int64_t value = parseSum();
+		while(true){
+			if(accept("<<"))
+				value <<= (parseSum() & 0x1F);
+			else if(accept(">>"))
+				value >>= (parseSum() & 0x1F);
+			else
+				return value;
+		}
+	}
+	int64_t parseSum(){
+		int64_t value = parseProduct();
+		while(true){
+			if(accept("+"))
+				value += parseProduct();
+			else if(accept("-"))
+				value -= parseProduct();
+			else
+				return value;
+		}
+	}
+	int64_t parseProduct(){
+		int64_t value = parseUnary();
+		while(true){
+			if(accept("*")){
+				value *= parseUnary();
+			} else if(accept("/") || accept("%")){
+				bool modulo = text[position - 1] == '%';
+				int64_t divisor = parseUnary();
+				if(divisor == 0){
+					if(!unresolved)
+						error("division by zero");
+					value = 0;
+				} else {
+					value = modulo ? value % divisor : value / divisor;
+				}
+			} else {
+				return value;
+			}
+		}
+	}
+	int64_t parseUnary(){
+		if(accept("-"))
+			return -parseUnary();
+		if(accept("+"))
+			return parseUnary();
+		if(accept("~"))
+			return ~parseUnary();
+		return parsePrimary();
+	}
+	int64_t parsePrimary(){
+		skipSpaces();
+		if(position >= text.size()){
+			error("missing operand in expression");
+			return 0;
+		}
+		char c = text[position];
+
+		if(c == '('){
+			position++;
+			int64_t value = parseOr();
+			if(!accept(")"))
+				error("missing ')'");
+			return value;
+		}
+		if(c == '$'){
+			position++;
+			if(position < text.size() && std::isxdigit(static_cast<unsigned char>(text[position])))
+				return parseNumber(16);
+			return lineAddress;
+		}
+		if(c == '\''){
+			if(position + 2 < text.size() && text[position + 2] == '\''){
+				int64_t value = static_cast<uint8_t>(text[position + 1]);
+				position += 3;
+				return value;
+			}
+			error("bad character constant");
+			position = text.size();
+			return 0;
+		}
+		if(std::isdigit(static_cast<unsigned char>(c)))
+			return parseNumber();
+		if(isIdentifierStart(c)){
+			size_t start = position;
+			while(position < text.size() && isIdentifierChar(text[position]))
+				position++;
+			std::string name = text.substr(start, position - start);
+			auto found = result.labels.find(name);
+			if(found != result.labels.end())
+				return found->second;
+			unresolved = true;
+			if(pass == 2)
+				error("undefined label '" + name + "'");
+			return 0;
+		}
+		error(std::string("unexpected '") + c + "' in expression");
+		position = text.size();
+		return 0;
+	}
+
+	int64_t parseNumber(int base = 10){
+		size_t start = position;
+		while(position < text.size() && std::isalnum(static_cast<unsigned char>(text[position])))
+			position++;
+		std::string digits = upper(text.substr(start, position - start));
+
+		if(base != 10){
+			// $-prefixed hex, no suffix
+		} else if(digits.size() > 2 && digits[0] == '0' && digits[1] == 'X'){
+			base = 16;
+			digits = digits.substr(2);
+		} else if(digits.size() > 2 && digits[0] == '0' && digits[1] == 'B' && digits.find_first_not_of("01", 2) == std::string::npos){
+			base = 2;
+			digits = digits.substr(2);
+		} else if(digits.back() == 'H'){
+			base = 16;
+			digits.pop_back();
+		} else if(digits.back() == 'B' && digits.find_first_not_of("01", 0) == digits.size() - 1){
+			base = 2;
+			digits.pop_back();
+		} else if(digits.back() == 'D'){
+			digits.pop_back();
+		}
+
+		int64_t value = 0;
+		for(char digit : digits){
+			int v = std::isdigit(static_cast<unsigned char>(digit)) ? digit - '0' : (digit >= 'A' && digit <= 'F' ? digit - 'A' + 10 : 99);
+			if(v >= base){
+				error("bad number '" + text.substr(start, position - start) + "'");
+				return 0;
+			}
+			value = value * base + v;
+		}
+		return value;
+	}
+};
+
+// Convenience wrapper for one-shot assembly
+inline AssemblyResult assemble(const std::string& source, uint8_t* memory, size_t memorySize, uint16_t origin = 0){
+	Assembler assembler;
+	return assembler.assemble(source, memory, memorySize, origin);
+}
+
+// Assembles into the memory of a CPU that may already have run, the written bytes are
+// reported to it like any other host write
+inline AssemblyResult assemble(const std::string& source, CPU& cpu, uint16_t origin = 0){
+	AssemblyResult result = assemble(source, cpu.memory, sizeof(cpu.memory), origin);
+	for(const auto& segment : result.segments)
+		cpu.hostWrote(segment.first, segment.second - segment.first);
+	return result;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Backing storage for switchable banks. The whole image is mapped at once but nothing is read
+// until a page is touched, so a multi-megabyte ROM costs only the pages the program uses.
+// Mappings are private: writes into a bank stay in this process and never reach the file.
+class BankStore {
+public:
+	BankStore() = default;
+	BankStore(const BankStore&) = delete;
+	BankStore& operator=(const BankStore&) = delete;
+	~BankStore(){
+		release();
+	}
+
+	// Maps an image file, its size is rounded up to whole host pages (the tail reads as 0)
+	bool open(const std::string& path){
+		release();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			return false;
+		struct stat info;
+		if(fstat(fd, &info) != 0 || info.st_size == 0){
+			::close(fd);
+			return false;
+		}
+		void* mapped = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(mapped == MAP_FAILED)
+			return false;
+		bytes = static_cast<uint8_t*>(mapped);
+		length = info.st_size;
+		return true;
+	}
+
+	// Zero filled RAM banks, pages are allocated by the OS on first write
+	bool allocate(size_t size){
+		release();
+		void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapped == MAP_FAILED)
+			return false;
+		bytes = static_cast<uint8_t*>(mapped);
+		length = size;
+		return true;
+	}
+
+	uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	uint8_t* bytes = nullptr;
+	size_t length = 0;
+
+	void release(){
+		if(bytes)
+			munmap(bytes, length);
+		bytes = nullptr;
+		length = 0;
+	}
+};
+
+// Address window whose pages show one bank of a BankStore at a time. Writing a bank number
+// to the select port (when there is one) switches the window.
+struct BankWindow {
+	uint16_t start;			// page aligned
+	uint32_t size;			// multiple of 256, also the size of one bank
+	int port;				// bank select port, -1 when only switched by the host
+	BankStore* store;
+	uint32_t bank;			// currently selected bank
+};
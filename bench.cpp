@@ -0,0 +1,15 @@
+// Throughput of the core on a fixed set of 8080 programs, one "bench" record per workload.
+//
+//   ./bench [million T-states per workload, default 200]
+//
+// The profile-guided build runs this (and ./cpu --bench) as its training run.
+
+#include <cstdlib>
+#include "bench.h"
+
+int main(int argc, char* argv[]){
+	uint64_t megaCycles = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200;
+	bool ok = runBenchmarks(megaCycles * 1000000);
+	logger().flush();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+#include "cpu.h"
+#include "assembler.h"
+
+// Benchmark suite, also the training run for profile-guided builds (see CMakeLists.txt), so
+// between them the workloads reach most of the dispatch switch and the fused sequences.
+// Every program loops forever and is run for a fixed number of T-states.
+struct BenchWorkload {
+	const char* name;
+	const char* source;
+};
+
+inline constexpr BenchWorkload benchWorkloads[] = {
+	// prog.asm scaled up to 256 bytes, refilled in reverse order after every sort
+	{"sort",
+	 "DATA	EQU 3000H\n"
+	 "		LXI SP, 0F000H\n"
+	 "again:	LXI H, DATA\n"
+	 "		MVI C, 0\n"
+	 "		MVI B, 0FFH\n"
+	 "fill:	MOV M,B\n"
+	 "		INX H\n"
+	 "		DCR B\n"
+	 "		DCR C\n"
+	 "		JNZ fill\n"
+	 "		MVI D, 0FFH\n"
+	 "outer:	LXI H, DATA\n"
+	 "		MVI C, 0FFH\n"
+	 "inner:	MOV A,M\n"
+	 "		INX H\n"
+	 "		MOV B,M\n"
+	 "		CMP B\n"
+	 "		JC skip\n"
+	 "		MOV M,A\n"
+	 "		DCX H\n"
+	 "		MOV M,B\n"
+	 "		INX H\n"
+	 "skip:	DCR C\n"
+	 "		JNZ inner\n"
+	 "		DCR D\n"
+	 "		JNZ outer\n"
+	 "		JMP again\n"},
+	// ALU, stack and subroutine traffic
+	{"arith",
+	 "		LXI SP, 0F000H\n"
+	 "		LXI H, 1234H\n"
+	 "		LXI D, 0101H\n"
+	 "loop:	CALL mix\n"
+	 "		DAD D\n"
+	 "		JMP loop\n"
+	 "mix:	PUSH H\n"
+	 "		MOV A,L\n"
+	 "		ADD H\n"
+	 "		ADC E\n"
+	 "		SUB D\n"
+	 "		SBB L\n"
+	 "		ANA H\n"
+	 "		XRA E\n"
+	 "		ORA D\n"
+	 "		RLC\n"
+	 "		RAR\n"
+	 "		CMA\n"
+	 "		INR A\n"
+	 "		DAA\n"
+	 "		MOV L,A\n"
+	 "		XCHG\n"
+	 "		XCHG\n"
+	 "		POP B\n"
+	 "		ADI 7\n"
+	 "		CPI 40H\n"
+	 "		RNC\n"
+	 "		INX H\n"
+	 "		RET\n"},
+	// 1 KB block copy
+	{"copy",
+	 "		LXI SP, 0F000H\n"
+	 "again:	LXI H, 2000H\n"
+	 "		LXI D, 4000H\n"
+	 "		LXI B, 0400H\n"
+	 "copy:	MOV A,M\n"
+	 "		STAX D\n"
+	 "		INX H\n"
+	 "		INX D\n"
+	 "		DCX B\n"
+	 "		MOV A,B\n"
+	 "		ORA C\n"
+	 "		JNZ copy\n"
+	 "		JMP again\n"},
+	// Port traffic
+	{"io",
+	 "loop:	IN 10H\n"
+	 "		ADD B\n"
+	 "		OUT 11H\n"
+	 "		INR B\n"
+	 "		JMP loop\n"}
+};
+
+// Random code slice: every opcode, the way fuzz.cpp runs it
+constexpr uint64_t BENCH_RANDOM_SLICE = 4096;
+
+struct BenchResult {
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t nanos = 0;
+};
+
+inline void reportBench(const char* name, const BenchResult& result){
+	char mhz[32];
+	snprintf(mhz, sizeof(mhz), "%.2f", result.nanos ? result.cycles * 1e3 / result.nanos : 0.0);
+	logger().record(LOG_INFO, "bench", {
+		{"workload", 0, 0, name}, {"cycles", result.cycles}, {"instructions", result.instructions},
+		{"ms", result.nanos / 1000000}, {"mhz", 0, 0, mhz}
+	});
+}
+
+// Runs every workload for nCycles T-states and logs a "bench" record for each. False when a
+// program does not assemble or stops before its budget.
+inline bool runBenchmarks(uint64_t nCycles){
+	bool ok = true;
+	for(const BenchWorkload& workload : benchWorkloads){
+		CPU cpu;
+		AssemblyResult program = assemble(workload.source, cpu);
+		for(const std::string& error : program.errors)
+			logger().error(std::string(workload.name) + ": " + error);
+		if(!program.ok){
+			ok = false;
+			continue;
+		}
+		auto started = std::chrono::steady_clock::now();
+		RunResult stop = cpu.run_for(nCycles);
+		BenchResult result;
+		result.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+		result.cycles = cpu.cycles;
+		result.instructions = cpu.instructions;
+		if(stop.reason != StopReason::CYCLE_BUDGET){
+			logger().error(std::string(workload.name) + ": stopped early, " + stopReasonName(stop.reason));
+			ok = false;
+		}
+		reportBench(workload.name, result);
+	}
+
+	CPU cpu;
+	cpu.setBaseline();
+	std::mt19937 random(0);
+	uint8_t code[512];
+	BenchResult result;
+	auto started = std::chrono::steady_clock::now();
+	while(result.cycles < nCycles){
+		cpu.resetToBaseline();
+		for(uint8_t& byte : code)
+			byte = static_cast<uint8_t>(random());
+		cpu.markDirty(0x0000, loadProgramFromBytes(code, sizeof(code), cpu.memory, sizeof(cpu.memory), 0x0000));
+		uint64_t before = cpu.instructions;
+		result.cycles += cpu.run_for(BENCH_RANDOM_SLICE).cycles;
+		result.instructions += cpu.instructions - before;
+	}
+	result.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+	reportBench("random", result);
+	return ok;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "cpu.h"
+
+// Several cores on one board. Memory they share is a BankStore mapped as a window into every
+// core's address space, everything outside the shared windows stays private to each core.
+//
+// Cores are interleaved in fixed quanta of T-states on a common board clock: within a quantum
+// each core in turn runs until its own clock reaches the end of the quantum, always in the
+// order they were added, so the same program and inputs always give the same interleaving.
+// A halted core waits the rest of the quantum out.
+class Board {
+public:
+	explicit Board(uint64_t quantum = 1000) : quantum(quantum) {}
+
+	uint64_t quantum;	// T-states per scheduling slice
+	uint64_t now = 0;	// board clock, T-states
+
+	size_t addCore(CPU& cpu){
+		cores.push_back({&cpu, cpu.cycles - now});
+		for(const SharedWindow& window : shared)
+			cpu.addBankWindow(window.start, window.size, *window.store);
+		return cores.size() - 1;
+	}
+	// Maps [start, start + size) of every core, present and future, onto the same storage.
+	// False when the window does not fit, see CPU::bankWindowFits().
+	bool shareMemory(BankStore& store, uint16_t start, uint32_t size){
+		if(!CPU::bankWindowFits(start, size, store))
+			return false;
+		shared.push_back({&store, start, size});
+		for(Core& core : cores)
+			core.cpu->addBankWindow(start, size, store);
+		return true;
+	}
+
+	bool allHalted(){
+		for(Core& core : cores)
+			if(!core.cpu->HALT || core.cpu->interruptReady() || core.cpu->replayWakeCycle() != UINT64_MAX)
+				return false;
+		return true;
+	}
+
+	// Runs every core for at least nCycles of board time on the calling thread, stops early
+	// once all cores are halted. Returns the board time that passed.
+	uint64_t run(uint64_t nCycles){
+		uint64_t start = now;
+		while(now - start < nCycles && !allHalted()){
+			uint64_t end = now + quantum;
+			for(Core& core : cores)
+				runQuantum(core, end);
+			now = end;
+		}
+		return now - start;
+	}
+
+	// Same schedule with one host thread per core, the threads meet at every quantum boundary.
+	// Only for cores that do not touch shared memory or each other within a quantum: their
+	// interleaving inside a quantum is up to the host and shared windows are not synchronized.
+	uint64_t runParallel(uint64_t nCycles){
+		uint64_t start = now;
+		uint64_t quanta = (nCycles + quantum - 1) / quantum;
+		Barrier barrier(cores.size());
+		std::vector<std::thread> threads;
+		bool stop = false;
+		for(size_t i = 0; i < cores.size(); i++){
+			threads.emplace_back([this, i, start, quanta, &barrier, &stop](){
+				for(uint64_t q = 1; q <= quanta; q++){
+					runQuantum(cores[i], start + q * quantum);
+					// The last thread to arrive checks for the end of the run
+					barrier.wait([&](){
+						now = start + q * quantum;
+						stop = allHalted();
+					});
+					if(stop)
+						break;
+				}
+			});
+		}
+		for(std::thread& thread : threads)
+			thread.join();
+		return now - start;
+	}
+
+private:
+	struct Core {
+		CPU* cpu;
+		uint64_t origin;	// cpu->cycles when the board clock was 0
+	};
+	struct SharedWindow {
+		BankStore* store;
+		uint16_t start;
+		uint32_t size;
+	};
+	std::vector<Core> cores;
+	std::vector<SharedWindow> shared;
+
+	void runQuantum(Core& core, uint64_t end){
+		CPU& cpu = *core.cpu;
+		uint64_t local = cpu.cycles - core.origin;
+		if(local < end)
+			cpu.run_for(end - local);
+		if(cpu.HALT && !cpu.interruptReady() && cpu.cycles - core.origin < end)
+			cpu.cycles = core.origin + end;
+	}
+
+	// Reusable barrier, the completion step runs on the last thread before the others resume
+	class Barrier {
+	public:
+		explicit Barrier(size_t count) : count(count) {}
+		template<typename Completion>
+		void wait(Completion completion){
+			std::unique_lock<std::mutex> lock(mutex);
+			size_t arrival = generation;
+			if(++waiting == count){
+				completion();
+				waiting = 0;
+				generation++;
+				released.notify_all();
+				return;
+			}
+			released.wait(lock, [&](){ return generation != arrival; });
+		}
+	private:
+		std::mutex mutex;
+		std::condition_variable released;
+		size_t count;
+		size_t waiting = 0;
+		size_t generation = 0;
+	};
+};
@@ -1,3 +1,22 @@
-g++ -o cpu main.cpp
-chmod +x ./cpu
-./cpu
\ No newline at end of file
+# ./build.sh [release|lto|pgo|debug], then runs ./cpu
+# pgo builds with a profile of the benchmark suite, see CMakeLists.txt
+set -e
+config=${1:-release}
+case "$config" in
+	release)	cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DEMU8080_LTO=OFF -DEMU8080_PGO=OFF ;;
+	lto)		cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DEMU8080_LTO=ON -DEMU8080_PGO=OFF ;;
+	debug)		cmake -S . -B build -DCMAKE_BUILD_TYPE=Debug -DEMU8080_LTO=OFF -DEMU8080_PGO=OFF ;;
+	pgo)
+		rm -rf build/profile
+		cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DEMU8080_LTO=ON -DEMU8080_PGO=GENERATE
+		cmake --build build -j"$(nproc)"
+		cmake --build build --target pgo-train
+		if ls build/profile/*.profraw >/dev/null 2>&1; then
+			llvm-profdata merge -o build/profile/default.profdata build/profile/*.profraw
+		fi
+		cmake -S . -B build -DEMU8080_PGO=USE ;;
+	*)	echo "usage: $0 [release|lto|pgo|debug]"; exit 1 ;;
+esac
+cmake --build build -j"$(nproc)"
+cp build/cpu ./cpu
+./cpu
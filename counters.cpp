@@ -0,0 +1,63 @@
+// Live counters of a running emulator, read from its shared memory block without stopping it.
+//
+//   g++ -O2 counters.cpp -o counters
+//   ./counters /8080emu [interval ms]
+//
+// Prints one line per interval with the rates over that interval.
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "perfcounters.h"
+
+int main(int argc, char* argv[]){
+	if(argc < 2){
+		logger().error(std::string("usage: ") + argv[0] + " <segment name> [interval ms]");
+		logger().flush();
+		return 1;
+	}
+	int interval = argc > 2 ? std::atoi(argv[2]) : 1000;
+	PerfReader reader;
+	if(!reader.open(argv[1])){
+		logger().error(std::string("no counters in shared memory segment ") + argv[1]);
+		logger().flush();
+		return 1;
+	}
+
+	PerfSnapshot last;
+	if(!reader.read(last)){
+		logger().error("writer stopped in the middle of an update");
+		logger().flush();
+		return 1;
+	}
+	while(true){
+		std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+		PerfSnapshot now;
+		if(!reader.read(now)){
+			logger().error("writer stopped in the middle of an update");
+			logger().flush();
+			return 1;
+		}
+		// Rates over the writer's own clock, nothing is reported until it published again
+		if(now.wallNanos == last.wallNanos)
+			continue;
+		double seconds = (now.wallNanos - last.wallNanos) / 1e9;
+		auto rate = [&](uint64_t from, uint64_t to){
+			return static_cast<uint64_t>((to - from) / seconds);
+		};
+		char mhz[32], cpu[32];
+		snprintf(mhz, sizeof(mhz), "%.2f", (now.cycles - last.cycles) / seconds / 1e6);
+		snprintf(cpu, sizeof(cpu), "%.1f", (now.hostCpuNanos - last.hostCpuNanos) / 1e7 / seconds);
+		logger().record(LOG_INFO, "perf", {
+			{"pid", now.pid},
+			{"instructions_per_sec", rate(last.instructions, now.instructions)},
+			{"mhz", 0, 0, mhz},
+			{"host_cpu_percent", 0, 0, cpu},
+			{"interrupts_per_sec", rate(last.interrupts, now.interrupts)},
+			{"io_per_sec", rate(last.portAccesses, now.portAccesses)}
+		});
+		logger().flush();
+		last = now;
+	}
+}
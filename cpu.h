@@ -0,0 +1,2670 @@
+#pragma once
+
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include <climits>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "log.h"
+#include "banks.h"
+#include "replay.h"
+ 
+// DDD = Destination, SSS = Source
+enum RegisterRefs {
+    A = 0b111,
+    B = 0b000,
+    C = 0b001,
+    D = 0b010,
+    E = 0b011,
+    H = 0b100,
+    L = 0b101,
+	FLAGS = 0b1000
+};
+ 
+// RP = Register Pair
+enum RegisterPairsRefs {
+    BC = 0b00,
+    DE = 0b01,
+    HL = 0b10,
+    SP = 0b11,
+    PC = 0b100,
+	PSW = 0b101
+};
+
+enum FlagType {
+    FLAG_Z  = 1 << 0,  // Zero
+    FLAG_S  = 1 << 1,  // Sign
+    FLAG_P  = 1 << 2,  // Parity
+    FLAG_AC = 1 << 3,  // Auxiliary Carry (calcul basé sur nibble inférieur)
+    FLAG_CY = 1 << 4   // Carry (valeur > 255 pour 8 bits)
+};
+
+enum OpCodes {
+	// 0x
+	NOP 		= 	0x00,		//	NOP									->	No operation
+	LXI_B_D16	=	0x01,		//	LXI 	B, 0bXXXXXXXXXXXXXXXX		->	Load register pair BC with 16-bit immediate value
+	STAX_B		=	0x02,		//	STAX 	BC							->	Store register A in memory address in register pair BC
+	INX_B		=	0x03,		//	INX 	BC							->	Increment register pair BC
+	INR_B		=	0x04,		//	INR		B							->	Increment register B
+	DCR_B		=	0x05,		//	DCR 	B 							->	Decrement register B
+	MVI_B_D8	=	0x06,		//	MVI		B, 0bXXXXXXXX				->	Load register B with 8-bit immediate value
+	RLC			=	0x07,		//	RLC									-> 	Rotate register A left (Circular)
+	//			=	0x08,		// --- Unused
+	DAD_B		=	0x09,		//	DAD		BC							-> 	Add register pair BC to register pair HL and store in register pair HL
+	LDAX_B		=	0x0A,		//	LDAX	BC							->	Load register A from memory address in register pair BC
+	DCX_B		=	0x0B,		//	DCX		BC							->	Decrement register pair BC
+	INR_C		=	0x0C,		//	INR		C							->	Increment register C
+	DCR_C		=	0x0D,		//	DCR		C							->	Decrement register C
+	MVI_C_D8	=	0x0E,		//	MVI		C, 0bXXXXXXXX				->	Load register C with 8-bit immediate value
+	RRC			=	0x0F,		//	RRC									->	Rotate register A right (Circular)
+ 
+	// 1x
+	//			=	0x10,
+	LXI_D_D16	=	0x11,		//	LXI		D, 0bXXXXXXXXXXXXXXXX		->	Load register pair DE with 16-bit immediate value
+	STAX_D		=	0x12,		//	STAX	DE							->	Store register A in memory address in register pair DE
+	INX_D		=	0x13,		//	INX		DE							->	Increment register pair DE
+	INR_D		=	0x14,		//	INR		D							->	Increment register D
+	DCR_D		=	0x15,		//	DCR		D							->	Decrement register D
+	MVI_D_D8	=	0x16,		//	MVI		D, 0bXXXXXXXX				->	Load register D with 8-bit immediate value
+	RAL			=	0x17,		//	RAL									->	Rotate register A left trought carry
+	//			=	0x18,		// --- Unused
+	DAD_D		=	0x19,		//	DAD		DE							->	Add register pair DE to register pair HL and store in register pair HL
+	LDAX_D		=	0x1A,		//	LDAX	DE							->	Load register A from memory address in register pair DE
+	DCX_D		=	0x1B,		//	DCX		DE							->	Decrement register pair DE
+	INR_E		= 	0x1C,		// 	INR		E							-> 	Increment register E
+	DCR_E		= 	0x1D,		// 	DCR		E							-> 	Decrement register E
+	MVI_E_D8	= 	0x1E,		// 	MVI		E, 0bXXXXXXXX				-> 	Load register E with 8-bit immediate value
+	RAR			= 	0x1F,		// 	RAR									-> 	Rotate register A right through carry
+ 
+	// 2x
+	RIM			= 	0x20,		// 	RIM									-> 	Read interrupt mask and serial data into register A
+	LXI_H_D16	= 	0x21,		// 	LXI		H, 0bXXXXXXXXXXXXXXXX		-> 	Load register pair HL with 16-bit immediate value
+	SHLD_A16	= 	0x22,		// 	SHLD	0bXXXXXXXXXXXXXXXX			-> 	Store register pair HL at immediate address
+	INX_H		= 	0x23,		// 	INX		HL							-> 	Increment register pair HL
+	INR_H		= 	0x24,		// 	INR		H							-> 	Increment register H
+	DCR_H		= 	0x25,		// 	DCR		H							-> 	Decrement register H
+	MVI_H_D8	= 	0x26,		// 	MVI		H, 0bXXXXXXXX				-> 	Load register H with 8-bit immediate value 
+	DAA			= 	0x27,		// 	DAA									-> 	Decimal adjust accumulator
+	//			=	0x28,		// --- Unused
+	DAD_H		= 	0x29,		// 	DAD		HL							-> 	Add register pair HL to register pair HL and store in register pair HL
+	LHLD_A16	= 	0x2A,		// 	LHLD	0bXXXXXXXX					-> 	Load register pair HL from immediate address
+	DCX_H		= 	0x2B,		// 	DCX		HL							-> 	Decrement register pair HL
+	INR_L		= 	0x2C,		// 	INR		L							-> 	Increment register L
+	DCR_L		= 	0x2D,		// 	DCR		L							-> 	Decrement register L
+	MVI_L_D8	= 	0x2E,		// 	MVI		L, 0bXXXXXXXXXXXXXXXX		-> 	Load register L with 8-bit immediate value
+	CMA			= 	0x2F,		// 	CMA									-> 	Complement register A
+ 
+	// 3x
+	SIM			= 	0x30,		// 	SIM									->	Set interrupt mask and serial data from register A
+	LXI_SP_D16	= 	0x31,		// 	LXI		SP, 0bXXXXXXXXXXXXXXXX		-> 	Load register SP from immediate address
+	STA_A16		= 	0x32,		// 	STA		0bXXXXXXXXXXXXXXXX			-> 	Store register A at immediate address
+	INX_SP		= 	0x33,		// 	INX		SP							-> 	Increment register pair SP
+	INR_M		= 	0x34,		// 	INR		M							-> 	Increment memory location pointed to by register pair HL
+	DCR_M		= 	0x35,		// 	DCR		M							-> 	Decrement memory location pointed to by register pair HL
+	MVI_M_D8	= 	0x36,		// 	MVI		M, 0bXXXXXXXX				-> 	Load memory location pointed to by register pair HL with 8-bit immediate
+	STC			= 	0x37,		// 	STC									->	Set carry flag
+	//			= 	0x38,		// --- Unused
+	DAD_SP		=	0x39,		//	DAD		SP							->	Add register pair SP to register pair HL and store in register pair HL
+	LDA_A16		= 	0x3A,		// 	LDA		0bXXXXXXXXXXXXXXXX			-> 	Load register A from immediate address
+	DCX_SP		= 	0x3B,		// 	DCX		SP							-> 	Decrement register pair SP
+	INR_A		= 	0x3C,		// 	INR		A							-> 	Increment register A
+	DCR_A		= 	0x3D,		// 	DCR		A							-> 	Decrement register A
+	MVI_A_D8	= 	0x3E,		// 	MVI		A, 0bXXXXXXXX				-> 	Load register A with 8-bit immediate value
+	CMC			= 	0x3F,		// 	CMC									-> 	Complement carry flag
+ 
+	// 4x
+	MOV_B_B		= 	0x40, 		//	MOV		B, B						->	Move value from register B to register B
+	MOV_B_C 	= 	0x41, 		//	MOV		B, C						->	Move value from register C to register B 
+	MOV_B_D 	= 	0x42,  		//	MOV		B, D						->	Move value from register D to register B
+	MOV_B_E 	= 	0x43, 		//	MOV		B, E						->	Move value from register E to register B
+	MOV_B_H		= 	0x44, 		//	MOV		B, H						->	Move value from register H to register B
+	MOV_B_L 	= 	0x45,  		//	MOV		B, L						->	Move value from register L to register B
+	MOV_B_M 	= 	0x46,  		//	MOV		B, M						->	Move value from memory address in register pair HL to register B
+	MOV_B_A 	= 	0x47, 		//	MOV		B, A						->	Move value from register A to register B
+	MOV_C_B		= 	0x48,  		//	MOV		C, B						->	Move value from register B to register C
+	MOV_C_C 	= 	0x49,  		//	MOV		C, C						->	Move value from register C to register C
+	MOV_C_D 	=	0x4A,  		//	MOV		C, D						->	Move value from register D to register C
+	MOV_C_E 	= 	0x4B,  		//	MOV		C, E						->	Move value from register E to register C
+	MOV_C_H		= 	0x4C,  		//	MOV		C, H						->	Move value from register H to register C 
+	MOV_C_L 	= 	0x4D,  		//	MOV		C, L						->	Move value from register L to register C 
+	MOV_C_M 	= 	0x4E,  		//	MOV		C, M						->	Move value frommemory address in register pair HL to register C 
+	MOV_C_A 	= 	0x4F,  		//	MOV		C, A						->	Move value from register A to register C
+ 
+	//	5x
+	MOV_D_B		= 	0x50,  		//	MOV		D, B						->	Move value from register B to register D
+	MOV_D_C 	= 	0x51,  		//	MOV		D, C						->	Move value from register C to register D 
+	MOV_D_D 	= 	0x52,  		//	MOV		D, D						->	Move value from register D to register D
+	MOV_D_E 	= 	0x53,  		//	MOV		D, E						->	Move value from register E to register D
+	MOV_D_H		= 	0x54,  		//	MOV		D, H						->	Move value from register H to register D
+	MOV_D_L 	= 	0x55,  		//	MOV		D, L						->	Move value from register L to register D
+	MOV_D_M 	= 	0x56,  		//	MOV		D, M						->	Move value from memory address in register pair HL to register D
+	MOV_D_A 	= 	0x57,  		//	MOV		D, A						->	Move value from register A to register D
+	MOV_E_B		= 	0x58,  		//	MOV		E, B						->	Move value from register B to register E
+	MOV_E_C 	= 	0x59,  		//	MOV		E, C						->	Move value from register C to register E
+	MOV_E_D 	= 	0x5A,  		//	MOV		E, D						->	Move value from register D to register E
+	MOV_E_E 	= 	0x5B,  		//	MOV		E, E						->	Move value from register E to register E
+	MOV_E_H		= 	0x5C,  		//	MOV		E, H						->	Move value from register H to register E
+	MOV_E_L 	= 	0x5D,  		//	MOV		E, L						->	Move value from register L to register E
+	MOV_E_M 	= 	0x5E,  		//	MOV		E, M						->	Move value from memory address in register pair HL to register E
+	MOV_E_A 	= 	0x5F,  		//	MOV		E, A						->	Move value from register A to register E
+ 
+	//	6x
+	MOV_H_B		= 	0x60,		//	MOV		H, B						-> 	Move value from register B to register H
+	MOV_H_C 	= 	0x61,		//	MOV		H, C						-> 	Move value from register C to register H
+	MOV_H_D 	= 	0x62,		//	MOV		H, D						-> 	Move value from register D to register H
+	MOV_H_E 	= 	0x63,		//	MOV		H, E						-> 	Move value from register E to register H
+	MOV_H_H		= 	0x64,		//	MOV		H, H						-> 	Move value from register H to register H
+	MOV_H_L 	= 	0x65,		//	MOV		H, L						-> 	Move value from register L to register H
+	MOV_H_M 	= 	0x66,		//	MOV		H, M						-> 	Move value from memory address in register pair HL to register H
+	MOV_H_A 	= 	0x67,		//	MOV		H, A						-> 	Move value from register A to register H
+	MOV_L_B		= 	0x68,		//	MOV		L, B						-> 	Move value from register B to register L
+	MOV_L_C 	= 	0x69,		//	MOV		L, C						-> 	Move value from register C to register L
+	MOV_L_D 	= 	0x6A,		//	MOV		L, D						-> 	Move value from register D to register L
+	MOV_L_E 	= 	0x6B,		//	MOV		L, E						-> 	Move value from register E to register L
+	MOV_L_H		= 	0x6C,		//	MOV		L, H						-> 	Move value from register H to register L
+	MOV_L_L 	= 	0x6D,		//	MOV		L, L						-> 	Move value from register L to register L
+	MOV_L_M 	= 	0x6E,		//	MOV		L, M						-> 	Move value from memory address in register pair HL to register L
+	MOV_L_A 	= 	0x6F,		//	MOV		L, A						-> 	Move value from register A to register L
+ 
+	//	7x
+	MOV_M_B		= 	0x70,		//	MOV		M, B						-> 	Move value from register B to memory address in register pair HL
+	MOV_M_C 	= 	0x71,		//	MOV		M, C						-> 	Move value from register C to memory address in register pair HL
+	MOV_M_D 	= 	0x72,		//	MOV		M, D						-> 	Move value from register D to memory address in register pair HL
+	MOV_M_E 	= 	0x73,		//	MOV		M, E						-> 	Move value from register E to memory address in register pair HL
+	MOV_M_H		= 	0x74,		//	MOV		M, H						-> 	Move value from register H to memory address in register pair HL
+	MOV_M_L 	= 	0x75,		//	MOV		M, L						-> 	Move value from register L to memory address in register pair HL
+	HLT			= 	0x76, 		//	HLT									-> 	Halt CPU
+	MOV_M_A 	= 	0x77,		//	MOV		M, A						-> 	Move value from register A to memory address in register pair HL
+	MOV_A_B		= 	0x78,		//	MOV		A, B						-> 	Move value from register B to register A
+	MOV_A_C 	= 	0x79,		//	MOV		A, C						-> 	Move value from register C to register A
+	MOV_A_D 	= 	0x7A,		//	MOV		A, D						-> 	Move value from register D to register A
+	MOV_A_E 	= 	0x7B,		//	MOV		A, E						-> 	Move value from register E to register A
+	MOV_A_H		= 	0x7C,		//	MOV		A, H						-> 	Move value from register H to register A
+	MOV_A_L 	= 	0x7D,		//	MOV		A, L						-> 	Move value from register L to register A
+	MOV_A_M 	= 	0x7E,		//	MOV		A, M						-> 	Move value from memory address in register pair HL to register A
+	MOV_A_A 	= 	0x7F,		//	MOV		A, A						-> 	Move value from register A to register A
+ 
+	// 8x
+	ADD_B		= 	0x80, 		//	ADD		B							->	Add value from register B to register A
+	ADD_C 		= 	0x81, 		//	ADD		C							->	Add value from register C to register A
+	ADD_D 		= 	0x82, 		//	ADD		D							->	Add value from register D to register A
+	ADD_E 		= 	0x83, 		//	ADD		E							->	Add value from register E to register A
+	ADD_H		= 	0x84, 		//	ADD		H							->	Add value from register H to register A
+	ADD_L 		= 	0x85, 		//	ADD		L							->	Add value from register L to register A
+	ADD_M 		= 	0x86, 		//	ADD		M							->	Add value from memory address in register pair HL to register A
+	ADD_A 		= 	0x87, 		//	ADD		A							->	Add value from register A to register A
+	ADC_B		= 	0x88, 		//	ADC		B							->	Add value from register B to register A with carry
+	ADC_C 		= 	0x89, 		//	ADC		C							->	Add value from register C to register A with carry 
+	ADC_D 		= 	0x8A, 		//	ADC		D							->	Add value from register D to register A with carry
+	ADC_E 		= 	0x8B, 		//	ADC		E							->	Add value from register E to register A with carry
+	ADC_H		= 	0x8C, 		//	ADC		H							->	Add value from register H to register A with carry
+	ADC_L	 	= 	0x8D, 		//	ADC		L							->	Add value from register L to register A with carry
+	ADC_M		= 	0x8E, 		//	ADC		M							->	Add value from memory address in register pair HL to register A with carry
+	ADC_A		= 	0x8F, 		//	ADC		A							->	Add value from register A to register A with carry
+ 
+	//	9x
+	SUB_B		= 	0x90,		//	SUB		B							-> 	Substract value from register B to register A
+	SUB_C 		= 	0x91,		//	SUB		C							-> 	Substract value from register C to register A
+	SUB_D 		= 	0x92,		//	SUB		D							-> 	Substract value from register D to register A
+	SUB_E 		= 	0x93,		//	SUB		E							-> 	Substract value from register E to register A
+	SUB_H		= 	0x94,		//	SUB		H							-> 	Substract value from register H to register A
+	SUB_L 		= 	0x95,		//	SUB		L							-> 	Substract value from register L to register A
+	SUB_M 		= 	0x96,		//	SUB		M							-> 	Substract value from memory address in register pair HL to register A
+	SUB_A 		= 	0x97,		//	SUB		A							-> 	Substract value from register A to register A
+	SBB_B		= 	0x98,		//	SBB		B							->	Substract value from register B to register A with borrow
+	SBB_C 		= 	0x99,		//	SBB		C							->	Substract value from register C to register A with borrow
+	SBB_D 		= 	0x9A,		//	SBB		D							->	Substract value from register D to register A with borrow
+	SBB_E 		= 	0x9B,		//	SBB		E							->	Substract value from register E to register A with borrow
+	SBB_H		= 	0x9C,		//	SBB		H							->	Substract value from register H to register A with borrow
+	SBB_L 		= 	0x9D,		//	SBB		L							->	Substract value from register L to register A with borrow
+	SBB_M 		= 	0x9E,		//	SBB		M							->	Substract value from memory address in register pair HL to register A with borrow
+	SBB_A 		= 	0x9F,		//	SBB		A							->	Substract value from register A to register A with borrow
+ 
+	//	Ax
+	ANA_B		= 	0xA0,		//	ANA		B							->	Logical AND register A with register B
+	ANA_C 		= 	0xA1,		//	ANA		C							->	Logical AND register A with register C
+	ANA_D 		= 	0xA2,		//	ANA		D							->	Logical AND register A with register D
+	ANA_E 		= 	0xA3,		//	ANA		E							->	Logical AND register A with register E
+	ANA_H		= 	0xA4,		//	ANA		H							->	Logical AND register A with register H
+	ANA_L 		= 	0xA5,		//	ANA		L							->	Logical AND register A with register L
+	ANA_M 		= 	0xA6,		//	ANA		M							->	Logical AND register A with value from memory address in register pair HL
+	ANA_A 		= 	0xA7,		//	ANA		A							->	Logical AND register A with register A
+	XRA_B		= 	0xA8,		//	XRA		B							->	Logical XOR	register A with register B
+	XRA_C 		= 	0xA9,		//	XRA		C							->	Logical XOR	register A with register C
+	XRA_D 		= 	0xAA,		//	XRA		D							->	Logical XOR	register A with register D
+	XRA_E 		= 	0xAB,		//	XRA		E							->	Logical XOR	register A with register E
+	XRA_H		= 	0xAC,		//	XRA		H							->	Logical XOR	register A with register H
+	XRA_L 		= 	0xAD,		//	XRA		L							->	Logical XOR	register A with register L
+	XRA_M 		= 	0xAE,		//	XRA		M							->	Logical XOR	register A with value from memory address in register pair HL
+	XRA_A 		= 	0xAF,		//	XRA		A							->	Logical XOR	register A with register A
+ 
+	//	Bx
+	ORA_B		= 	0xB0,		//	ORA		B							->	Logical OR register A with register B
+	ORA_C 		= 	0xB1,		//	ORA		C							->	Logical OR register A with register C
+	ORA_D 		= 	0xB2,		//	ORA		D							->	Logical OR register A with register D
+	ORA_E 		= 	0xB3,		//	ORA		E							->	Logical OR register A with register E
+	ORA_H		= 	0xB4,		//	ORA		H							->	Logical OR register A with register H
+	ORA_L 		= 	0xB5,		//	ORA		L							->	Logical OR register A with register L
+	ORA_M 		= 	0xB6,		//	ORA		M							->	Logical OR register A with value from memory address in register pair HL
+	ORA_A 		= 	0xB7,		//	ORA		A							->	Logical OR register A with register A
+	CMP_B		= 	0xB8, 		//	CMP		B							->	Compare register A with register B
+	CMP_C 		= 	0xB9, 		//	CMP		C							->	Compare register A with register C
+	CMP_D 		= 	0xBA, 		//	CMP		D							->	Compare register A with register D
+	CMP_E 		= 	0xBB, 		//	CMP		E							->	Compare register A with register E
+	CMP_H		= 	0xBC, 		//	CMP		H							->	Compare register A with register H
+	CMP_L 		= 	0xBD, 		//	CMP		L							->	Compare register A with register L
+	CMP_M 		= 	0xBE, 		//	CMP		M							->	Compare register A with value from memory address in register pair HL
+	CMP_A 		= 	0xBF, 		//	CMP		A							->	Compare register A with register A
+ 
+	//	Cx
+	RNZ			= 	0xC0,		//	RNZ									->	Return from subroutine if not zero														(Flag ZERO = 0)
+	POP_B 		= 	0xC1, 		//	POP		B							->	Pop from stack into register pair BC
+	JNZ_A16		= 	0xC2,		//	JNZ		0bXXXXXXXXXXXXXXXX			->	Jump if not zero to immediate address 													(Flag ZERO = 0)
+	JMP_A16		= 	0xC3,		//	JMP		0bXXXXXXXXXXXXXXXX			->	Jump to immediate address
+	CNZ_A16		= 	0xC4, 		//	CNZ		0bXXXXXXXXXXXXXXXX			->	Call subroutine if not zero at immediate address 										(Flag ZERO = 0)
+	PUSH_B 		= 	0xC5,		//	PUSH	B							->	Push register pair BC to stack
+	ADI_D8 		= 	0xC6,		//	ADI		0bXXXXXXXX					->	Add immediate 8-bit value to register A
+	RST_0 		= 	0xC7,		//	RST		0							->	Call restart subroutine at address 0x0000
+	RZ			= 	0xC8, 		//	RZ									->	Return from subroutine if zero															(Flag ZERO = 1)
+	RET 		= 	0xC9,		//	RET									->	Return from subroutine
+	JZ_A16		= 	0xCA,		//	JZ		0bXXXXXXXXXXXXXXXX			->	Jump if zero to immediate address														(Flag ZERO = 1)
+	// 			=	0xCB, 		// --- Unused
+	CZ_A16		=	0xCC,		// 	CZ		0bXXXXXXXXXXXXXXXX			->	Call subroutine if zero at immediate address											(Flag ZERO = 1)
+	CALL_A16	= 	0xCD,		//	CALL	0bXXXXXXXXXXXXXXXX			->	Call subroutine at immediate address
+	ACI_D8 		= 	0xCE, 		//	ACI		0bXXXXXXXX					->	Add immediate value to register A with carry
+	RST_1 		= 	0xCF,		//	RST		1							->	Call restart subroutine at address 0x0008
+ 
+	//	Dx
+	RNC			= 	0xD0,		//	RNC									->	Return from subroutine if not carry														(Flag CARRY = 0)
+	POP_D 		= 	0xD1, 		//	POP		D							-> 	Pop from stack into register pair DE
+	JNC_A16		= 	0xD2,		//	JNC		0bXXXXXXXXXXXXXXXX			->	Jump if not carry to immediate address													(Flag CARRY = 0)
+	OUT_D8 		= 	0xD3,		//	OUT		0bXXXXXXXX					->	Output register A to specified port
+	CNC_A16		= 	0xD4, 		//	CNC		0bXXXXXXXXXXXXXXXX			->	Call subroutine if not carry at immediate address										(Flag CARRY	= 0)
+	PUSH_D 		= 	0xD5,		//	PUSH	D							->	Push register pair DE to stack
+	SUI_D8 		= 	0xD6, 		//	SUI		0bXXXXXXXX					->	Substract immediate 8-bit value from register A
+	RST_2 		= 	0xD7,		//	RST		2							->	Call restart subroutine at address 0x0010
+	RC			= 	0xD8, 		//	RC									->	Return from subroutine if carry															(Flag CARRY = 1)
+	// 			=	0xD9,		// --- Unused
+	JC_A16		= 	0xDA,		//	JC		0bXXXXXXXXXXXXXXXX			->	Jump if carry to immediate address														(Flag CARRY = 1)
+	IN_D8 		= 	0xDB,		//	IN		0bXXXXXXXX					->	Input from specified port to register A
+	CC_A16		=	0xDC,		//	CC		0bXXXXXXXXXXXXXXXX			->	Call subroutine if carry at immediate address											(Flag CARRY = 1)
+	// 			=	0xDD		// --- Unused
+	SBI_D8		= 	0xDE, 		//	SBI		0bXXXXXXXX					->	Substract immediate 8-bit value from register A with borrow
+	RST_3 		=	0xDF,		//	RST		3							->	Call restart subroutine at address 0x0018
+ 
+	//	Ex
+	RPO			= 	0xE0, 		//	RPO									->	Return from subroutine if parity is odd													(Flag PARITY = 0)
+	POP_H 		= 	0xE1,		//	POP		H							->	Pop from stack into register pair HL
+	JPO_A16		= 	0xE2,		//	JPO		0bXXXXXXXXXXXXXXXX			->	Jump if parity is odd to immediate address												(Flag PARITY = 0)
+	XTHL		= 	0xE3,		//	XTHL								->	Exchange register pair HL with the word on top of the stack
+	CPO_A16		= 	0xE4, 		//	CPO		0bXXXXXXXXXXXXXXXX			->	Call subroutine if parity is odd at immediate address									(Flag PARITY = 0)
+	PUSH_H 		= 	0xE5,		//	PUSH	H							->	Push register pair HL to stack
+	ANI_D8 		= 	0xE6, 		//	ANI		0bXXXXXXXX					->	Logicial AND register A with immediate 8-bit value
+	RST_4 		= 	0xE7,		//	RST		4							->	Call restart subroutine at address 0x0020
+	RPE			= 	0xE8,		//	RPE									->	Return from subroutine if parity is even												(Flag PARITY = 1)
+	PCHL 		= 	0xE9,		//	PCHL								->	Load program counter from register pair HL
+	JPE_A16		= 	0xEA, 		//	JPE		0bXXXXXXXXXXXXXXXX			->	Jump if parity is even to immediate address												(Flag PARITY = 1)
+	XCHG		= 	0xEB,		//	XCHG								->	Exchange register pair DE and register pair HL
+	CPE_A16		=	0xEC, 		//	CPE		0bXXXXXXXXXXXXXXXX			->	Call subroutine if parity is even at immediate address									(Flag PARITY = 1)
+	// 			=	0xED		// --- Unused
+	XRI_D8		= 	0xEE, 		//	XRI		0bXXXXXXXX					->	Logicial XOR register A with immediate 8-bit value
+	RST_5 		= 	0xEF,		//	RST		5							->	Call restart subroutine at address 0x0028
+ 
+	//	Fx
+	RP			= 	0xF0,		//	RP									->	Return from subroutine if sign is plus													(Flag SIGN = 0)
+	POP_PSW 	= 	0xF1,		//	POP		PSW							->	Pop from stack into register pair constructed from register A and register FLAGS
+	JP_A16		= 	0xF2,		//	JP		0bXXXXXXXXXXXXXXXX			->	Jump if sign is plus to immediate address												(Flag SIGN = 0)
+	DI 			= 	0xF3,		//	DI									->	Disable interrupts
+	CP_A16		= 	0xF4, 		//	CP		0bXXXXXXXXXXXXXXXX			->	Call subroutine if sign is plus at immediate address									(Flag SIGN = 0)
+	PUSH_PSW 	= 	0xF5, 		//	PUSH	PSW							-> 	Push register pair constructed from register A and register FLAGS to stack
+	ORI_D8 		= 	0xF6, 		//	ORI		0bXXXXXXXX					->	Logical OR register A with immediate 8-bit value
+	RST_6 		= 	0xF7,		//	RST		6							->	Call restart subroutine at address 0x0030
+	RM			= 	0xF8,		//	RM									->	Return from subroutine is sign is minus													(FLAG SIGN = 1)
+	SPHL 		= 	0xF9, 		//	SPHL								->	Load stack pointer from register pair HL
+	JM_A16		= 	0xFA, 		//	JM		0bXXXXXXXXXXXXXXXX			->	Jump if sign is minus to immediate address												(Flag SIGN = 1)
+	EI 			= 	0xFB,		//	EI									->	Enable interrupts
+	CM_A16		= 	0xFC, 		//	CM		0bXXXXXXXXXXXXXXXX			->	Call subroutine if sign is minus at immediate address									(Flag SIGN = 1)
+	// 			=	0xFD		// --- Unused
+	CPI_D8		= 	0xFE, 		//	CPI		0bXXXXXXXX					->	Compare register A with immediate value
+	RST_7 		= 	0xFF		//	RST		7							->	Call restart subroutine at address 0x0038
+};
+
+// ALU operations sharing the same accumulator kernel (ADD/ADC/SUB/SBB/ANA/XRA/ORA/CMP
+// and their immediate forms ADI/ACI/SUI/SBI/ANI/XRI/ORI/CPI)
+enum class AluOp { ADD, ADC, SUB, SBB, ANA, XRA, ORA, CMP };
+
+// Where the second operand comes from : register SSS, memory at HL (M) or the byte after the opcode
+enum class AluSrc { REG, M, IMM };
+
+inline void setBit(uint8_t& byte, uint8_t bit, bool value) {
+    if (value) {
+        byte |= (1 << bit);     // Met le bit à 1
+    } else {
+        byte &= ~(1 << bit);    // Met le bit à 0
+    }
+}
+
+// Access kinds for watchpoints, on memory (read/write) or I/O ports (IN/OUT)
+enum WatchType {
+	WATCH_READ	= 1 << 0,	// memory read or IN
+	WATCH_WRITE	= 1 << 1	// memory write or OUT
+};
+
+struct Watchpoint {
+	uint16_t start;		// first watched address (or port)
+	uint16_t end;		// last watched address (or port), inclusive
+	uint8_t type;		// WatchType mask
+	bool io;			// true for an I/O port watch
+};
+
+void printAddressArray(uint8_t address[], int addressSize, int baseAddress = 0, LogLevel level = LOG_INFO);
+
+// Memory mapped device occupying [start, end]. Accesses inside the range go to the handlers
+// instead of the memory array, a missing handler leaves that direction as plain RAM.
+struct MmioRegion {
+	uint16_t start;
+	uint16_t end;
+	std::function<uint8_t(uint16_t)> read;
+	std::function<void(uint16_t, uint8_t)> write;
+};
+
+// Access rights of a page, see CPU::protect()
+enum PagePermission {
+	PERM_READ	= WATCH_READ,
+	PERM_WRITE	= WATCH_WRITE,
+	PERM_EXEC	= 1 << 2,
+	PERM_ALL	= PERM_READ | PERM_WRITE | PERM_EXEC
+};
+
+// Permissions written as in "r-x": the letters r, w and x in any order, '-' for none
+inline bool parsePermissions(const std::string& text, uint8_t& permissions){
+	permissions = 0;
+	for(char c : text){
+		if(c == 'r')
+			permissions |= PERM_READ;
+		else if(c == 'w')
+			permissions |= PERM_WRITE;
+		else if(c == 'x')
+			permissions |= PERM_EXEC;
+		else if(c != '-')
+			return false;
+	} 
+	return !text.empty();
+}
+
+// Per 256-byte page bits of CPU::pageFlags, 0 means plain RAM
+enum PageFlag {
+	PAGE_WATCH_READ		= WATCH_READ,
+	PAGE_WATCH_WRITE	= WATCH_WRITE,
+	PAGE_MMIO			= 4,	// at least one MmioRegion touches the page
+	PAGE_BANKED			= 8,	// the page belongs to a BankWindow, see CPU::bankPages
+	PAGE_CODE			= 16,	// a superinstruction was decoded from the page
+	PAGE_CLEAN			= 32,	// unchanged since the baseline, the first write marks it dirty
+	PAGE_NO_READ		= 64,	// protection, data reads fault
+	PAGE_NO_WRITE		= 128,	// protection, writes fault and are dropped
+	PAGE_NO_EXEC		= 256	// protection, instructions fault
+};
+// Flags that send a data access through readSlow() / writeSlow()
+constexpr uint16_t PAGE_SLOW_READ = PAGE_WATCH_READ | PAGE_MMIO | PAGE_BANKED | PAGE_NO_READ;
+constexpr uint16_t PAGE_SLOW_WRITE = PAGE_WATCH_WRITE | PAGE_MMIO | PAGE_BANKED | PAGE_CODE | PAGE_CLEAN | PAGE_NO_WRITE;
+
+// Access refused by the page permissions
+struct ProtectionFault {
+	uint16_t address;	// byte accessed, or the instruction for PERM_EXEC
+	uint16_t pc;		// instruction that made the access
+	uint8_t access;		// PERM_READ, PERM_WRITE or PERM_EXEC
+};
+
+// Why run_for()/run_until() handed control back to the host
+enum class StopReason {
+	NONE,
+	HALTED,			// HLT executed
+	CYCLE_BUDGET,	// requested number of cycles consumed
+	PC_MATCH,		// reg_PC reached StopCondition::pc
+	MEMORY_WATCH,	// watched memory byte changed
+	PORT_EVENT,		// IN/OUT on the watched port
+	PREDICATE,		// host predicate returned true
+	BREAKPOINT,		// reg_PC reached a breakpoint
+	WATCHPOINT,		// a watched memory range or port was accessed
+	PROTECTION_FAULT,	// an access the page permissions refuse, see CPU::fault
+	INSTRUCTION_BUDGET,	// RunLimits::maxInstructions executed
+	DEADLINE			// RunLimits::timeoutNanos of wall-clock time passed
+};
+
+inline const char* stopReasonName(StopReason reason){
+	switch(reason){
+		case StopReason::NONE:			return "none";
+		case StopReason::HALTED:		return "halted";
+		case StopReason::CYCLE_BUDGET:	return "cycle_budget";
+		case StopReason::PC_MATCH:		return "pc_match";
+		case StopReason::MEMORY_WATCH:	return "memory_watch";
+		case StopReason::PORT_EVENT:	return "port_event";
+		case StopReason::PREDICATE:		return "predicate";
+		case StopReason::BREAKPOINT:	return "breakpoint";
+		case StopReason::WATCHPOINT:	return "watchpoint";
+		case StopReason::PROTECTION_FAULT:	return "protection_fault";
+		case StopReason::INSTRUCTION_BUDGET:	return "instruction_budget";
+		case StopReason::DEADLINE:		return "deadline";
+	} 
+	return "unknown";
+}
+
+// T-states per opcode. Conditional CALL and RET hold their not-taken cost, CPU::step() adds
+// the 6 extra states when the condition holds (Ccc 11/17, Rcc 5/11). The undocumented opcodes
+// run as 1-byte NOPs and cost 4 like NOP, including the JMP/RET/CALL aliases CB, D9 and xD.
+inline constexpr uint8_t opcodeCycles[256] = {
+	4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4,		// 0x
+	4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4,		// 1x
+	4, 10, 16,  5,  5,  5,  7,  4,  4, 10, 16,  5,  5,  5,  7,  4,		// 2x
+	4, 10, 13,  5, 10, 10, 10,  4,  4, 10, 13,  5,  5,  5,  7,  4,		// 3x
+	5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,		// 4x
+	5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,		// 5x
+	5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,		// 6x
+	7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5,		// 7x
+	4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,		// 8x
+	4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,		// 9x
+	4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,		// Ax
+	4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,		// Bx
+	5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10,  4, 11, 17,  7, 11,		// Cx
+	5, 10, 10, 10, 11, 11,  7, 11,  5,  4, 10, 10, 11,  4,  7, 11,		// Dx
+	5, 10, 10, 18, 11, 11,  7, 11,  5,  5, 10,  5, 11,  4,  7, 11,		// Ex
+	5, 10, 10,  4, 11, 11,  7, 11,  5,  5, 10,  4, 11,  4,  7, 11		// Fx
+};
+
+// Superinstructions: frequent sequences executed with a single dispatch. CPU::fusion caches
+// which one (if any) starts at each address.
+enum Fusion : uint8_t {
+	FUSE_UNDECODED = 0,
+	FUSE_NONE,				// no sequence starts here
+	FUSE_DCR_JNZ,			// DCR r; JNZ a16
+	FUSE_MOV_A_M_INX_H,		// MOV A,M; INX H
+	FUSE_CMP_JC,			// CMP r; JC a16
+	FUSE_CMP_JNC,			// CMP r; JNC a16
+	FUSE_LXI_MVI,			// LXI rp,d16; MVI r,d8
+	FUSE_COMPARE_NEXT,		// MOV A,M; INX H; MOV B,M; CMP B; JC a16 (sort inner loop)
+	FUSE_COUNT
+};
+
+struct FusionInfo {
+	const char* name;
+	uint8_t length;			// bytes covered
+	uint8_t instructions;	// dispatches it replaces
+	uint8_t cycles;
+};
+
+inline constexpr FusionInfo fusionTable[FUSE_COUNT] = {
+	{"",                  0, 0,  0},
+	{"",                  0, 0,  0},
+	{"DCR r; JNZ",        4, 2, 15},
+	{"MOV A,M; INX H",    2, 2, 12},
+	{"CMP r; JC",         4, 2, 14},
+	{"CMP r; JNC",        4, 2, 14},
+	{"LXI rp; MVI r",     5, 2, 17},
+	{"MOV A,M .. JC",     7, 5, 33}
+};
+// Longest sequence, a write can invalidate entries up to this many bytes back
+constexpr int FUSION_MAX_LENGTH = 7;
+
+// Superinstruction starting at op[0], given the next FUSION_MAX_LENGTH instruction bytes
+inline uint8_t matchFusion(const uint8_t op[FUSION_MAX_LENGTH]){
+	auto isReg = [](uint8_t field){ return (field & 7) != 6; };	// 6 is M
+
+	if(op[0] == MOV_A_M && op[1] == INX_H && op[2] == MOV_B_M && op[3] == CMP_B && op[4] == JC_A16)
+		return FUSE_COMPARE_NEXT;
+	if(op[0] == MOV_A_M && op[1] == INX_H)
+		return FUSE_MOV_A_M_INX_H;
+	if((op[0] & 0xC7) == 0x05 && isReg(op[0] >> 3) && op[1] == JNZ_A16)
+		return FUSE_DCR_JNZ;
+	if((op[0] & 0xF8) == 0xB8 && isReg(op[0]) && op[1] == JC_A16)
+		return FUSE_CMP_JC;
+	if((op[0] & 0xF8) == 0xB8 && isReg(op[0]) && op[1] == JNC_A16)
+		return FUSE_CMP_JNC;
+	if((op[0] & 0xCF) == 0x01 && (op[3] & 0xC7) == 0x06 && isReg(op[3] >> 3))
+		return FUSE_LXI_MVI;
+	return FUSE_NONE;
+}
+
+// Stop conditions for run_until(), unused fields are left at -1
+struct StopCondition {
+	static constexpr int ANY_PORT = 0x100;
+
+	int pc = -1;				// stop before executing the instruction at this address
+	int watchAddress = -1;		// stop after an instruction modified this memory byte
+	int port = -1;				// stop after IN/OUT on this port (ANY_PORT for every port)
+	uint64_t maxCycles = UINT64_MAX;
+};
+
+struct RunResult {
+	StopReason reason = StopReason::NONE;
+	uint64_t cycles = 0;	// cycles executed by this call
+	uint16_t pc = 0;		// reg_PC at the stop
+	uint16_t address = 0;	// watched address or port that caused the stop
+	uint8_t access = 0;		// WatchType of the access for WATCHPOINT stops, PagePermission for faults
+};
+
+class CPU;
+
+// Watchdog for CPU::run_limited(). Limits count from the start of the call and are checked
+// between slices of sliceCycles T-states, so the run loop itself stays free of clock reads.
+struct RunLimits {
+	uint64_t maxCycles = UINT64_MAX;
+	uint64_t maxInstructions = UINT64_MAX;
+	uint64_t timeoutNanos = UINT64_MAX;		// wall clock
+	uint64_t sliceCycles = 1000000;		// 0 is taken as 1
+	std::function<void(CPU&)> onSlice;		// called after every slice, e.g. to publish counters
+
+	// Reason the first exhausted limit stops the run with, NONE while all have some left
+	StopReason exceeded(uint64_t ranCycles, uint64_t executed, uint64_t elapsedNanos) const {
+		if(ranCycles >= maxCycles)
+			return StopReason::CYCLE_BUDGET;
+		if(executed >= maxInstructions)
+			return StopReason::INSTRUCTION_BUDGET;
+		if(elapsedNanos >= timeoutNanos)
+			return StopReason::DEADLINE;
+		return StopReason::NONE;
+	}
+};
+
+class CPU {
+public:
+	uint8_t reg_A = 0, reg_B = 0, reg_C = 0, reg_D = 0, reg_E = 0, reg_H = 0, reg_L = 0; // ACCUMULATOR, GENERAL REGISTERS (8 bits)
+	uint16_t reg_SP = 0, reg_PC = 0; // STACK POINTER, PROGRAM COUNTER (16 bits)
+	uint8_t reg_FLAGS = 0; // INTERNAL
+
+	uint8_t memory[0x10000] = {0x00};
+	uint8_t ports[0x100] = {0x00};
+
+	bool HALT = false;
+	uint64_t cycles = 0;	// T-states since power on
+
+	// Host side statistics, kept across reset() so a pooled instance counts its whole life
+	uint64_t instructions = 0;		// a fused sequence counts every instruction in it
+	uint64_t interruptsTaken = 0;
+	uint64_t portAccesses = 0;		// IN and OUT
+	uint64_t cyclesBeforeReset = 0;
+
+	// Interrupts. EI takes effect after the following instruction, a request stays pending
+	// until interrupts are enabled and is serviced as an RST to vector * 8.
+	bool INTE = false;
+	bool enablePending = false;
+	bool interruptPending = false;
+	uint8_t interruptVector = 0;
+
+	// Optional IN/interrupt log. While replaying, onInput and interrupt() are ignored.
+	InputLog* inputLog = nullptr;
+
+	// Superinstructions, used by run_for()/run_until() when nothing needs to stop between
+	// the fused instructions. fusionCounts tells how often each one ran.
+	bool fuseInstructions = true;
+	uint8_t fusion[0x10000] = {0};
+	bool fusionPages[0x100] = {false};		// pages with decoded entries
+	uint64_t fusionCounts[FUSE_COUNT] = {0};
+
+	// Optional host devices, called on IN/OUT. Without them ports behave as plain latches.
+	std::function<uint8_t(uint8_t)> onInput;
+	std::function<void(uint8_t, uint8_t)> onOutput;
+	uint8_t lastPort = 0;
+	bool portEvent = false;
+
+	// Debugger state. Breakpoints are a bit per address plus a count per 256-byte page,
+	// watchpoints are flagged per page so unwatched accesses only cost a table lookup.
+	uint64_t breakpoints[0x10000 / 64] = {0};
+	uint16_t breakpointPages[0x100] = {0};
+	int breakpointCount = 0;
+	int resumeBreakpoint = -1;		// PC of the last BREAKPOINT stop, not tested again when a run starts on it
+	std::vector<Watchpoint> watchpoints;
+	uint8_t portWatch[0x100] = {0};
+	bool watchHit = false;
+	uint16_t watchHitAddress = 0;
+	uint8_t watchHitType = 0;
+
+	// Memory bus. RAM pages have no flags and are a direct array access, watched, device and
+	// banked pages take the slow path. Opcode and operand fetches only look at banking.
+	std::vector<MmioRegion> mmioRegions;
+	std::vector<BankWindow> bankWindows;
+	uint8_t* bankPages[0x100] = {nullptr};	// host address of each banked page
+	uint16_t pageFlags[0x100] = {0};
+
+	// Protection, set per page with protect(). A refused access stops the CPU like HLT until
+	// the host calls clearFault(): reads return 0xFF, writes are dropped and an instruction on
+	// a page without PERM_EXEC is not executed. Debugger accesses are never refused.
+	uint8_t deniedAccess[0x100] = {0};		// PagePermission bits refused per page
+	bool faulted = false;
+	ProtectionFault fault = {};
+	uint16_t instructionPC = 0;				// start of the instruction being executed
+
+	// Memory resetToBaseline() returns to and the pages written since, a bit per page
+	std::unique_ptr<uint8_t[]> baseline;
+	uint64_t dirtyPages[0x100 / 64] = {0};
+
+	uint8_t fetch(uint16_t address){
+		if(pageFlags[address >> 8] & PAGE_BANKED)
+			return bankPages[address >> 8][address & 0xFF];
+		return memory[address];
+	}
+	// Debugger access, no watchpoints or device side effects
+	uint8_t peekByte(uint16_t address){
+		return fetch(address);
+	}
+	void pokeByte(uint16_t address, uint8_t d8){
+		// Read-only pages do not flag their code, only this path can change it
+		if(pageFlags[address >> 8] & (PAGE_CODE | PAGE_NO_WRITE))
+			invalidateFusion(address);
+		if(pageFlags[address >> 8] & PAGE_CLEAN)
+			markPageDirty(address >> 8);
+		if(pageFlags[address >> 8] & PAGE_BANKED)
+			bankPages[address >> 8][address & 0xFF] = d8;
+		else
+			memory[address] = d8;
+	}
+
+	uint8_t readByte(uint16_t address){
+		if(pageFlags[address >> 8] & PAGE_SLOW_READ)
+			return readSlow(address);
+		return memory[address];
+	}
+	void writeByte(uint16_t address, uint8_t d8){
+		if(pageFlags[address >> 8] & PAGE_SLOW_WRITE)
+			return writeSlow(address, d8);
+		memory[address] = d8;
+	}
+	uint8_t readSlow(uint16_t address){
+		uint16_t flags = pageFlags[address >> 8];
+		if(flags & PAGE_NO_READ){
+			raiseFault(address, PERM_READ);
+			return 0xFF;
+		} 
+		if(flags & PAGE_WATCH_READ)
+			checkWatchpoints(address, WATCH_READ, false);
+		if(flags & PAGE_MMIO){
+			MmioRegion* region = findMmioRegion(address);
+			if(region && region->read)
+				return region->read(address);
+		} 
+		return peekByte(address);
+	}
+	void writeSlow(uint16_t address, uint8_t d8){
+		uint16_t flags = pageFlags[address >> 8];
+		if(flags & PAGE_NO_WRITE)
+			return raiseFault(address, PERM_WRITE);
+		if(flags & PAGE_WATCH_WRITE)
+			checkWatchpoints(address, WATCH_WRITE, false);
+		if(flags & PAGE_MMIO){
+			MmioRegion* region = findMmioRegion(address);
+			if(region && region->write)
+				return region->write(address, d8);
+		} 
+		pokeByte(address, d8);
+	}
+	MmioRegion* findMmioRegion(uint16_t address){
+		for(MmioRegion& region : mmioRegions)
+			if(address >= region.start && address <= region.end)
+				return &region;
+		return nullptr;
+	}
+	void mapMmio(uint16_t start, uint16_t end, std::function<uint8_t(uint16_t)> read, std::function<void(uint16_t, uint8_t)> write){
+		mmioRegions.push_back({start, end, std::move(read), std::move(write)});
+		rebuildPageFlags();
+	}
+	void unmapMmio(uint16_t start){
+		for(size_t i = 0; i < mmioRegions.size(); i++){
+			if(mmioRegions[i].start == start){
+				mmioRegions.erase(mmioRegions.begin() + i);
+				break;
+			} 
+		} 
+		rebuildPageFlags();
+	}
+	// Whether [start, start + size) can be a window over store: whole pages inside the address
+	// space and at least one bank in the store
+	static bool bankWindowFits(uint32_t start, uint32_t size, const BankStore& store){
+		return (start & 0xFF) == 0 && size != 0 && (size & 0xFF) == 0 && start + size <= 0x10000 && store.size() >= size;
+	}
+	// Banked window over [start, start + size), showing bank 0 of the store. Returns the
+	// window index for selectBank(), -1 when the window does not fit (see bankWindowFits).
+	int addBankWindow(uint16_t start, uint32_t size, BankStore& store, int port = -1){
+		if(!bankWindowFits(start, size, store))
+			return -1;
+		bankWindows.push_back({start, size, port, &store, 0});
+		rebuildPageFlags();
+		selectBank(bankWindows.size() - 1, 0);
+		return static_cast<int>(bankWindows.size() - 1);
+	}
+	// Points the window's page table entries at another bank, nothing is copied. A bank
+	// past the end of the store is refused and the window keeps its current bank.
+	bool selectBank(size_t window, uint32_t bank){
+		BankWindow& banked = bankWindows[window];
+		size_t offset = static_cast<size_t>(bank) * banked.size;
+		if(offset + banked.size > banked.store->size())
+			return false;
+		uint8_t* base = banked.store->data() + offset;
+		for(uint32_t page = 0; page < banked.size >> 8; page++)
+			bankPages[(banked.start >> 8) + page] = base + (page << 8);
+		banked.bank = bank;
+		for(uint32_t page = 0; page < banked.size >> 8; page++)
+			clearFusionPage((banked.start >> 8) + page);
+		return true;
+	}
+
+	void checkWatchpoints(uint16_t address, uint8_t type, bool io){
+		for(const Watchpoint& watch : watchpoints){
+			if(watch.io == io && (watch.type & type) && address >= watch.start && address <= watch.end){
+				watchHit = true;
+				watchHitAddress = address;
+				watchHitType = type;
+				return;
+			} 
+		} 
+	}
+
+	bool isBreakpoint(uint16_t address){
+		return (breakpoints[address >> 6] >> (address & 63)) & 1;
+	}
+	void addBreakpoint(uint16_t address){
+		if(isBreakpoint(address))
+			return;
+		breakpoints[address >> 6] |= 1ULL << (address & 63);
+		breakpointPages[address >> 8]++;
+		breakpointCount++;
+	}
+	void removeBreakpoint(uint16_t address){
+		if(!isBreakpoint(address))
+			return;
+		breakpoints[address >> 6] &= ~(1ULL << (address & 63));
+		breakpointPages[address >> 8]--;
+		breakpointCount--;
+	}
+	void addWatchpoint(uint16_t start, uint16_t end, uint8_t type){
+		watchpoints.push_back({start, end, type, false});
+		rebuildPageFlags();
+	}
+	void addPortWatchpoint(uint8_t port, uint8_t type){
+		watchpoints.push_back({port, port, type, true});
+		rebuildPageFlags();
+	}
+	// Removes the watchpoint with exactly this range and WatchType mask
+	void removeWatchpoint(uint16_t start, uint16_t end, uint8_t type, bool io = false){
+		for(size_t i = 0; i < watchpoints.size(); i++){
+			if(watchpoints[i].start == start && watchpoints[i].end == end && watchpoints[i].type == type && watchpoints[i].io == io){
+				watchpoints.erase(watchpoints.begin() + i);
+				break;
+			} 
+		} 
+		rebuildPageFlags();
+	}
+	void rebuildPageFlags(){
+		for(uint16_t& flags : pageFlags)
+			flags &= PAGE_CODE | PAGE_CLEAN;
+		for(int page = 0; page < 0x100; page++){
+			if(deniedAccess[page] & PERM_READ)
+				pageFlags[page] |= PAGE_NO_READ;
+			if(deniedAccess[page] & PERM_WRITE)
+				pageFlags[page] |= PAGE_NO_WRITE;
+			if(deniedAccess[page] & PERM_EXEC)
+				pageFlags[page] |= PAGE_NO_EXEC;
+		} 
+		std::fill(std::begin(portWatch), std::end(portWatch), 0);
+		for(const Watchpoint& watch : watchpoints){
+			if(watch.io){
+				portWatch[watch.start] |= watch.type;
+				continue;
+			} 
+			for(int page = watch.start >> 8; page <= (watch.end >> 8); page++)
+				pageFlags[page] |= watch.type;
+		} 
+		for(const MmioRegion& region : mmioRegions)
+			for(int page = region.start >> 8; page <= (region.end >> 8); page++)
+				pageFlags[page] |= PAGE_MMIO;
+		for(const BankWindow& banked : bankWindows)
+			for(uint32_t page = 0; page < banked.size >> 8; page++)
+				pageFlags[(banked.start >> 8) + page] |= PAGE_BANKED;
+	}
+	// Access rights of the pages in [start, start + size), e.g. from a loader's segment table.
+	// Superinstructions decoded under the old rights are dropped.
+	void protect(uint16_t start, uint32_t size, uint8_t permissions){
+		if(!size)
+			return;
+		uint8_t denied = ~permissions & PERM_ALL;
+		for(uint32_t page = start >> 8; page <= (start + size - 1) >> 8 && page < 0x100; page++){
+			if(deniedAccess[page] == denied)
+				continue;
+			deniedAccess[page] = denied;
+			clearFusionPage(page);
+		} 
+		rebuildPageFlags();
+	}
+	// The first refused access of an instruction is kept, the CPU stops after it
+	void raiseFault(uint16_t address, uint8_t access){
+		if(faulted)
+			return;
+		faulted = true;
+		fault = {address, instructionPC, access};
+		HALT = true;
+	}
+	// Lets a stopped CPU go on after the host handled the fault
+	void clearFault(){
+		if(faulted)
+			HALT = false;
+		faulted = false;
+	}
+
+	bool debugActive(){
+		return breakpointCount != 0 || !watchpoints.empty();
+	}
+
+	void setRegister(RegisterRefs reg, uint8_t d8) {
+ 
+	    switch(reg) {
+	        case RegisterRefs::A:
+	            reg_A = d8;
+	            break;
+	        case RegisterRefs::B:
+	            reg_B = d8;
+	            break;
+	        case RegisterRefs::C:
+	            reg_C = d8;
+	            break;
+	        case RegisterRefs::D:
+	            reg_D = d8;
+	            break;
+	        case RegisterRefs::E:
+	            reg_E = d8;
+	            break;
+	        case RegisterRefs::H:
+	            reg_H = d8;
+	            break;
+	        case RegisterRefs::L:
+	            reg_L = d8;
+	            break;
+			case RegisterRefs::FLAGS:
+				reg_FLAGS = d8;
+				break;
+	    }
+	}
+	void setRegisterPair(RegisterPairsRefs reg, uint16_t d16) {
+	    switch(reg) {
+	        case RegisterPairsRefs::BC:
+	            reg_B = (d16 >> 8) & 0xFF;
+	            reg_C = d16 & 0xFF;
+	            break;
+	        case RegisterPairsRefs::DE:
+	            reg_D = (d16 >> 8) & 0xFF;
+	            reg_E = d16 & 0xFF;
+	            break;
+	        case RegisterPairsRefs::HL:
+	            reg_H = (d16 >> 8) & 0xFF;
+	            reg_L = d16 & 0xFF;
+	            break;
+	        case RegisterPairsRefs::SP:
+	            reg_SP = d16;
+	            break;
+			case RegisterPairsRefs::PSW:
+				reg_A = (d16 >> 8) & 0xFF;
+				reg_FLAGS = d16 & 0xFF;
+				break;
+	        default:
+	            reg_PC = d16;
+	            break;
+	    }
+	}
+	void setRegisterPair(RegisterPairsRefs reg, uint8_t d8h, uint8_t d8l) {
+	    switch(reg) {
+	        case RegisterPairsRefs::BC:
+	            reg_B = d8h;
+	            reg_C = d8l;
+	            break;
+	        case RegisterPairsRefs::DE:
+	            reg_D = d8h;
+	            reg_E = d8l;
+	            break;
+	        case RegisterPairsRefs::HL:
+	            reg_H = d8h;
+	            reg_L = d8l;
+	            break;
+	        case RegisterPairsRefs::SP:
+	            reg_SP = (static_cast<uint16_t>(d8h) << 8) | d8l;
+	            break;
+	        case RegisterPairsRefs::PC:
+	            reg_PC = (static_cast<uint16_t>(d8h) << 8) | d8l;
+	            break;
+	        default:
+	            break;
+	    }
+	}
+ 
+	uint8_t getRegister(RegisterRefs reg) {
+	    switch(reg){
+	        case RegisterRefs::A:
+	            return reg_A;
+	            break;
+	        case RegisterRefs::B:
+	            return reg_B;
+	            break;
+	        case RegisterRefs::C:
+	            return reg_C;
+	            break;
+	        case RegisterRefs::D:
+	            return reg_D;
+	            break;
+	        case RegisterRefs::E:
+	            return reg_E;
+	            break;
+	        case RegisterRefs::H:
+	            return reg_H;
+	            break;
+	        case RegisterRefs::L:
+	            return reg_L;
+	            break;
+			case RegisterRefs::FLAGS:
+				return reg_FLAGS;
+	        default:
+	            return 0;
+	            break;
+	    } 
+	    return 0;
+	} 
+	uint16_t getRegister(RegisterPairsRefs reg) {
+	    switch(reg) {
+	        case RegisterPairsRefs::BC:
+	            return (static_cast<uint16_t>(reg_B) << 8) | reg_C;
+	            break;
+	        case RegisterPairsRefs::DE:
+	            return (static_cast<uint16_t>(reg_D) << 8) | reg_E;
+	            break;
+	        case RegisterPairsRefs::HL:
+	            return (static_cast<uint16_t>(reg_H) << 8) | reg_L;
+	            break;
+	        case RegisterPairsRefs::SP:
+	            return reg_SP;
+	            break;
+	        case RegisterPairsRefs::PC:
+	            return reg_PC;
+	            break;
+			case RegisterPairsRefs::PSW:
+				return (static_cast<uint16_t>(reg_A) << 8) | reg_FLAGS;
+				break;
+	        default:
+	            return 0;
+	            break;
+	    } 
+	    return 0;
+	} 
+
+	bool flag_Z = false, flag_S = false, flag_P = false, flag_CY = false, flag_AC = false; // ZERO, SIGN, PARITY, CARRY, AUX-CARRY
+
+	void checkFlags(uint8_t value, uint8_t previous, uint8_t flagsToCheck) {
+		if (flagsToCheck & FLAG_Z)
+			flag_Z = (value == 0);
+
+		if (flagsToCheck & FLAG_S)
+			flag_S = (value & 0x80) != 0;
+
+		if (flagsToCheck & FLAG_P) {
+			uint8_t count = 0;
+			for (uint8_t i = 0; i < 8; ++i)
+				if (value & (1 << i)) ++count;
+					flag_P = (count % 2 == 0);  // even parity
+		}
+
+		if (flagsToCheck & FLAG_AC)
+			flag_AC = ((previous & 0x0F) + (value & 0x0F)) > 0x0F;
+
+		if (flagsToCheck & FLAG_CY){
+			if(previous == 0xFF){
+				if(value > 0xFF || value == 0){
+					flag_CY = true;
+				} else {
+					flag_CY = false;
+				} 
+			} else {
+				flag_CY = false;
+			} 
+		} 
+		
+	}
+	void setFlagReg(){
+		reg_FLAGS = static_cast<uint8_t>(flag_S << 7 | flag_Z << 6 | flag_AC << 4 | flag_P << 2 | flag_CY);
+	} 
+	void loadFlagReg(){
+		flag_CY = reg_FLAGS & (1 << 0);
+		flag_P = reg_FLAGS & (1 << 2);
+		flag_AC = reg_FLAGS & (1 << 4);
+		flag_Z = reg_FLAGS & (1 << 6);
+		flag_S = reg_FLAGS & (1 << 7);
+	} 
+
+	void MOV(RegisterRefs dest, RegisterRefs src){
+	    setRegister(dest, getRegister(src));
+	}
+	void MVI(RegisterRefs dest, uint8_t d8){
+	    setRegister(dest, d8);
+	}  
+	void LXI(RegisterPairsRefs dest, uint8_t d8h, uint8_t d8l){
+		setRegisterPair(dest, d8h, d8l);
+	} 
+	void STAX(RegisterPairsRefs destAddr){
+		writeByte(getRegister(destAddr), getRegister(RegisterRefs::A));
+	} 
+	void INX(RegisterPairsRefs dest){
+		setRegisterPair(dest, getRegister(dest)+1);
+	}  
+	void DCX(RegisterPairsRefs dest){
+		setRegisterPair(dest, getRegister(dest)-1);
+	} 
+	void INR(RegisterRefs dest){
+		uint8_t prev = getRegister(dest);
+		setRegister(dest, getRegister(dest)+1);
+		checkFlags(getRegister(dest), prev, FLAG_S | FLAG_Z | FLAG_AC | FLAG_P);
+	} 
+	void DCR(RegisterRefs dest){
+		uint8_t prev = getRegister(dest);
+		setRegister(dest, getRegister(dest)-1);
+		checkFlags(getRegister(dest), prev, FLAG_S | FLAG_Z | FLAG_AC | FLAG_P);
+	} 
+	// Rotates only touch CY
+	void RLC_op(){
+		flag_CY = (reg_A & 0x80) != 0;
+		reg_A = static_cast<uint8_t>(reg_A << 1 | flag_CY);
+	}
+	void RRC_op(){
+		flag_CY = (reg_A & 0x01) != 0;
+		reg_A = static_cast<uint8_t>(reg_A >> 1 | flag_CY << 7);
+	}
+	void RAL_op(){
+		bool carry = flag_CY;
+		flag_CY = (reg_A & 0x80) != 0;
+		reg_A = static_cast<uint8_t>(reg_A << 1 | carry);
+	}
+	void RAR_op(){
+		bool carry = flag_CY;
+		flag_CY = (reg_A & 0x01) != 0;
+		reg_A = static_cast<uint8_t>(reg_A >> 1 | carry << 7);
+	}
+	void RIM_op(){}; 
+	void SIM_op(){}; 
+	void DAA_op(){
+		uint8_t adjust = 0;
+		bool carry = flag_CY;
+		if ((reg_A & 0x0F) > 9 || flag_AC) adjust |= 0x06;
+		if (reg_A > 0x99 || flag_CY) {
+			adjust |= 0x60;
+			carry = true;
+		}
+		flag_AC = ((reg_A & 0x0F) + (adjust & 0x0F)) > 0x0F;
+		reg_A = static_cast<uint8_t>(reg_A + adjust);
+		flag_CY = carry;
+		flag_S = (reg_A & 0x80) != 0;
+		flag_Z = (reg_A == 0);
+		flag_P = !__builtin_parity(reg_A);
+	}
+	void CMA_op(){
+		reg_A = static_cast<uint8_t>(~reg_A);
+	}
+	void DAD(RegisterPairsRefs src){
+		uint8_t prev = getRegister(src);
+		setRegisterPair(RegisterPairsRefs::HL, getRegister(RegisterPairsRefs::HL)+getRegister(src));
+		checkFlags(getRegister(src), prev, FLAG_CY);
+	}  
+	void LDAX(RegisterPairsRefs srcAddr){
+		setRegister(RegisterRefs::A, readByte(getRegister(srcAddr)));
+	} 
+	void SHLD(uint16_t destAddr){
+		writeByte(destAddr, getRegister(RegisterRefs::L));
+		writeByte(destAddr+1, getRegister(RegisterRefs::H));  
+	} 
+	void LHLD(uint16_t srcAddr){
+		setRegister(RegisterRefs::L, readByte(srcAddr));
+		setRegister(RegisterRefs::H, readByte(srcAddr+1));
+	} 
+	void STA(uint16_t destAddr){
+		writeByte(destAddr, getRegister(RegisterRefs::A)); 
+	}  
+	void LDA(uint16_t srcAddr){
+		setRegister(RegisterRefs::A, readByte(srcAddr));
+	} 
+	void STC_op(){
+		flag_CY = true;
+	}
+	void CMC_op(){
+		flag_CY = !flag_CY;
+	}
+	template<RegisterRefs reg>
+	uint8_t& registerRef(){
+		static_assert(reg != RegisterRefs::FLAGS, "FLAGS is not an ALU operand");
+		if constexpr (reg == RegisterRefs::A) return reg_A;
+		else if constexpr (reg == RegisterRefs::B) return reg_B;
+		else if constexpr (reg == RegisterRefs::C) return reg_C;
+		else if constexpr (reg == RegisterRefs::D) return reg_D;
+		else if constexpr (reg == RegisterRefs::E) return reg_E;
+		else if constexpr (reg == RegisterRefs::H) return reg_H;
+		else return reg_L;
+	}
+
+	// Single accumulator kernel, everything is resolved at compile time so each instantiation
+	// is a straight-line sequence without flag mask tests.
+	// Subtraction is done the way the 8080 does it : A + ~value + 1 (or + !CY for SBB).
+	// CY is then the inverted carry out of bit 7 (borrow) and AC the carry into bit 4.
+	template<AluOp op>
+	void aluKernel(uint8_t value){
+		constexpr bool isSub = (op == AluOp::SUB || op == AluOp::SBB || op == AluOp::CMP);
+		constexpr bool isArith = (op == AluOp::ADD || op == AluOp::ADC || isSub);
+		uint8_t acc = reg_A;
+		uint8_t result;
+
+		if constexpr (isArith) {
+			uint8_t operand = isSub ? static_cast<uint8_t>(~value) : value;
+			uint8_t carryIn;
+			if constexpr (op == AluOp::ADC) carryIn = flag_CY;
+			else if constexpr (op == AluOp::SBB) carryIn = !flag_CY;
+			else carryIn = isSub;
+			uint16_t sum = acc + operand + carryIn;
+			result = static_cast<uint8_t>(sum);
+			flag_CY = ((sum >> 8) & 1) ^ isSub;
+			flag_AC = ((acc ^ operand ^ sum) & 0x10) != 0;
+		} else {
+			if constexpr (op == AluOp::ANA) result = acc & value;
+			else if constexpr (op == AluOp::XRA) result = acc ^ value;
+			else result = acc | value;
+			flag_CY = false;
+			// ANA sets AC from the OR of bit 3 of both operands, XRA/ORA clear it
+			flag_AC = (op == AluOp::ANA) && (((acc | value) & 0x08) != 0);
+		}
+
+		flag_S = (result & 0x80) != 0;
+		flag_Z = (result == 0);
+		flag_P = !__builtin_parity(result);  // even parity
+
+		if constexpr (op != AluOp::CMP)
+			reg_A = result;
+	}
+
+	template<AluOp op, AluSrc src, RegisterRefs reg = RegisterRefs::A>
+	void ALU(){
+		if constexpr (src == AluSrc::REG) {
+			aluKernel<op>(registerRef<reg>());
+		} else if constexpr (src == AluSrc::M) {
+			aluKernel<op>(readByte(getRegister(RegisterPairsRefs::HL)));
+		} else {
+			aluKernel<op>(fetch(reg_PC + 1));
+			reg_PC++;
+		}
+	}
+	// Conditional jumps, calls and returns share one handler per class. The condition comes
+	// from opcode bits 5-3 and is tested against the packed PSW in reg_FLAGS. Like the other
+	// handlers they leave PC one byte before the next instruction, step() adds the final 1.
+	void Jcc(uint8_t opcode, uint16_t destAddr){
+		reg_PC = conditionMet((opcode >> 3) & 7) ? destAddr - 1 : reg_PC + 2;
+	}
+	void Ccc(uint8_t opcode, uint16_t destAddr){
+		if(conditionMet((opcode >> 3) & 7))
+			CALL(destAddr);
+		else
+			reg_PC += 2;
+	}
+	void Rcc(uint8_t opcode){
+		if(conditionMet((opcode >> 3) & 7))
+			RET_op();
+	}
+	void JMP(uint16_t destAddr){
+		reg_PC = destAddr - 1;
+	} 
+	void CALL(uint16_t destAddr){
+		pushWord(reg_PC + 3);
+		reg_PC = destAddr - 1;
+	}
+	void RET_op(){
+		reg_PC = popWord() - 1;
+	}
+	void RST(int mode){
+		pushWord(reg_PC + 1);
+		reg_PC = mode * 8 - 1;
+	}
+	void PUSH_op(RegisterPairsRefs src){
+		pushWord(getRegister(src));
+	}
+	void POP_op(RegisterPairsRefs dest){
+		setRegisterPair(dest, popWord());
+	}
+	void PUSHpsw(){
+		pushWord(static_cast<uint16_t>(reg_A << 8 | reg_FLAGS));
+	}
+	void POPpsw(){
+		uint16_t value = popWord();
+		reg_A = value >> 8;
+		reg_FLAGS = value & 0xFF;
+		loadFlagReg();
+	}
+	void pushWord(uint16_t value){
+		writeByte(--reg_SP, value >> 8);
+		writeByte(--reg_SP, value & 0xFF);
+	}
+	uint16_t popWord(){
+		uint8_t low = readByte(reg_SP++);
+		return static_cast<uint16_t>(readByte(reg_SP++) << 8 | low);
+	}
+	void OUT(uint8_t portAddr){
+		if(portWatch[portAddr] & WATCH_WRITE)
+			checkWatchpoints(portAddr, WATCH_WRITE, true);
+		ports[portAddr] = getRegister(RegisterRefs::A);
+		for(size_t window = 0; window < bankWindows.size(); window++)
+			if(bankWindows[window].port == portAddr)
+				selectBank(window, ports[portAddr]);
+		if(onOutput)
+			onOutput(portAddr, ports[portAddr]);
+		lastPort = portAddr;
+		portEvent = true;
+		portAccesses++;
+	} 
+	void IN(uint8_t portAddr){
+		if(portWatch[portAddr] & WATCH_READ)
+			checkWatchpoints(portAddr, WATCH_READ, true);
+		if(inputLog && inputLog->replaying()){
+			if(!inputLog->nextInput(cycles, portAddr, ports[portAddr])){
+				logger().error("replay diverged at cycle " + std::to_string(cycles) + ", IN 0x" + Logger::hexString(portAddr, 2));
+				HALT = true;
+			} 
+		} else if(onInput){
+			ports[portAddr] = onInput(portAddr);
+		} 
+		if(inputLog)
+			inputLog->recordInput(cycles, portAddr, ports[portAddr]);
+		setRegister(RegisterRefs::A, ports[portAddr]);
+		lastPort = portAddr;
+		portEvent = true;
+		portAccesses++;
+	} 
+	void PCHL_op(){
+		reg_PC = getRegister(RegisterPairsRefs::HL) - 1;
+	} 
+	void XTHL_op(){
+		uint16_t top = popWord();
+		pushWord(getRegister(RegisterPairsRefs::HL));
+		setRegisterPair(RegisterPairsRefs::HL, top);
+	}
+	void SPHL_op(){
+		setRegisterPair(RegisterPairsRefs::SP, getRegister(RegisterPairsRefs::HL));
+	};  
+
+	void getOperation(){
+		uint16_t ref = reg_PC;
+		uint16_t temp = 0;
+		uint8_t opcode = fetch(reg_PC);
+		switch(opcode){
+			case NOP:
+				break;
+			case LXI_B_D16:
+				LXI(RegisterPairsRefs::BC, fetch(ref + 2), fetch(ref + 1));
+				reg_PC = reg_PC + 2;
+				break;
+			case STAX_B:
+				STAX(RegisterPairsRefs::BC);
+				break;
+			case INX_B:
+				INX(RegisterPairsRefs::BC);
+				break;
+			case INR_B:
+				INR(RegisterRefs::B);
+				break;
+			case DCR_B:
+				DCR(RegisterRefs::B);
+				break;
+			case MVI_B_D8:
+				MVI(RegisterRefs::B, fetch(ref + 1));
+				reg_PC++;
+				break;
+			case RLC: 
+				RLC_op();
+				break;
+			case DAD_B:
+				DAD(RegisterPairsRefs::BC);
+				break;
+			case LDAX_B:
+				LDAX(RegisterPairsRefs::BC);
+				break;
+			case DCX_B:
+				DCX(RegisterPairsRefs::BC);
+				break;
+			case INR_C:
+				INR(RegisterRefs::C);
+				break;
+			case DCR_C:
+				DCR(RegisterRefs::C);
+				break;
+			case MVI_C_D8:
+				MVI(RegisterRefs::C, fetch(ref + 1));
+				reg_PC++;
+				break;
+			case RRC:
+				RRC_op();
+				break;
+
+			case LXI_D_D16:
+				LXI(RegisterPairsRefs::DE, fetch(ref + 2), fetch(ref + 1));
+				reg_PC = reg_PC + 2;
+				break;
+			case STAX_D:
+				STAX(RegisterPairsRefs::DE);
+				break;
+			case INX_D:
+				INX(RegisterPairsRefs::DE);
+				break;
+			case INR_D:
+				INR(RegisterRefs::D);
+				break;
+			case DCR_D:
+				DCR(RegisterRefs::D);
+				break;
+			case MVI_D_D8:
+				MVI(RegisterRefs::D, fetch(ref + 1));
+				reg_PC++;
+				break;
+			case RAL:
+				RAL_op();
+				break;
+			case DAD_D:
+				DAD(RegisterPairsRefs::DE);
+				break;
+			case LDAX_D:
+				LDAX(RegisterPairsRefs::DE);
+				break;
+			case DCX_D:
+				DCX(RegisterPairsRefs::DE);
+				break;
+			case INR_E:
+				INR(RegisterRefs::E);
+				break;
+			case DCR_E:
+				DCR(RegisterRefs::E);
+				break;
+			case MVI_E_D8:
+				MVI(RegisterRefs::E, fetch(ref + 1));
+				reg_PC++;
+				break;
+			case RAR:
+				RAR_op();
+				break;
+		
+			case RIM:
+				RIM_op();
+				break;
+			case LXI_H_D16:
+				LXI(RegisterPairsRefs::HL, fetch(ref + 2), fetch(ref + 1));
+				reg_PC = reg_PC + 2;
+				break;
+			case SHLD_A16:
+				SHLD(static_cast<uint16_t>(fetch(ref + 2) << 8 | fetch(ref + 1)));
+				reg_PC = reg_PC + 2;
+				break;
+			case INX_H:
+				INX(RegisterPairsRefs::HL);
+				break;
+			case INR_H:
+				INR(RegisterRefs::H);
+				break;
+			case DCR_H:
+				DCR(RegisterRefs::H);
+				break;
+			case MVI_H_D8:
+				MVI(RegisterRefs::H, fetch(ref + 1));
+				reg_PC++;
+				break;
+			case DAA:
+				DAA_op();
+				break;
+			case DAD_H:
+				DAD(RegisterPairsRefs::HL);
+				break;
+			case LHLD_A16:
+				LHLD(static_cast<uint16_t>(fetch(ref + 2) << 8 | fetch(ref + 1)));
+				reg_PC = reg_PC + 2;
+				break;
+			case DCX_H:
+				DCX(RegisterPairsRefs::HL);
+				break;
+			case INR_L:
+				INR(RegisterRefs::L);
+				break;
+			case DCR_L:
+				DCR(RegisterRefs::L);
+				break;
+			case MVI_L_D8:
+				MVI(RegisterRefs::L, fetch(ref + 1));
+				reg_PC++;
+				break;
+			case CMA:
+				CMA_op();
+				break;
+
+			case SIM:
+				SIM_op();
+				break;
+			case LXI_SP_D16:
+				LXI(RegisterPairsRefs::SP, fetch(ref + 2), fetch(ref + 1));
+				reg_PC = reg_PC + 2;
+				break;
+			case STA_A16:
+				STA(static_cast<uint16_t>(fetch(ref + 2) << 8 | fetch(ref + 1)));
+				reg_PC = reg_PC + 2;
+				break;
+			case INX_SP:
+				INX(RegisterPairsRefs::SP);
+				break;
+			case INR_M:
+				writeByte(getRegister(RegisterPairsRefs::HL), readByte(getRegister(RegisterPairsRefs::HL)) + 1);
+				break;
+			case DCR_M:
+				writeByte(getRegister(RegisterPairsRefs::HL), readByte(getRegister(RegisterPairsRefs::HL)) - 1);
+				break;
+			case MVI_M_D8:
+				writeByte(getRegister(RegisterPairsRefs::HL), fetch(ref + 1));
+				reg_PC++;
+				break;
+			case STC:
+				STC_op();
+				break;  
+			case DAD_SP:
+				DAD(RegisterPairsRefs::SP);
+				break;
+			case LDA_A16:
+				LDA(static_cast<uint16_t>(fetch(ref + 2) << 8 | fetch(ref + 1)));
+				reg_PC = reg_PC + 2;
+				break;
+			case DCX_SP:
+				DCX(RegisterPairsRefs::SP);
+				break;
+			case INR_A:
+				INR(RegisterRefs::A);
+				break;
+			case DCR_A:
+				DCR(RegisterRefs::A);
+				break;
+			case MVI_A_D8:
+				MVI(RegisterRefs::A, fetch(ref + 1));
+				reg_PC++;
+				break;
+			case CMC:
+				CMC_op();
+				break;
+
+			case MOV_B_B:
+				MOV(RegisterRefs::B, RegisterRefs::B);
+				break;
+			case MOV_B_C:
+				MOV(RegisterRefs::B, RegisterRefs::C);
+				break;
+			case MOV_B_D:
+				MOV(RegisterRefs::B, RegisterRefs::D);
+				break;
+			case MOV_B_E:
+				MOV(RegisterRefs::B, RegisterRefs::E);
+				break;
+			case MOV_B_H:
+				MOV(RegisterRefs::B, RegisterRefs::H);
+				break;
+			case MOV_B_L:
+				MOV(RegisterRefs::B, RegisterRefs::L);
+				break;
+			case MOV_B_M:
+				setRegister(RegisterRefs::B, readByte(getRegister(RegisterPairsRefs::HL)));
+				break;
+			case MOV_B_A:
+				MOV(RegisterRefs::B, RegisterRefs::A);
+				break;
+			case MOV_C_B:
+				MOV(RegisterRefs::C, RegisterRefs::B);
+				break;
+			case MOV_C_C:
+				MOV(RegisterRefs::C, RegisterRefs::C);
+				break;
+			case MOV_C_D:
+				MOV(RegisterRefs::C, RegisterRefs::D);
+				break;
+			case MOV_C_E:
+				MOV(RegisterRefs::C, RegisterRefs::E);
+				break;
+			case MOV_C_H:
+				MOV(RegisterRefs::C, RegisterRefs::H);
+				break;
+			case MOV_C_L:
+				MOV(RegisterRefs::C, RegisterRefs::L);
+				break;
+			case MOV_C_M:
+				setRegister(RegisterRefs::C, readByte(getRegister(RegisterPairsRefs::HL)));
+				break;
+			case MOV_C_A:
+				MOV(RegisterRefs::C, RegisterRefs::A);
+				break;
+
+			case MOV_D_B:
+				MOV(RegisterRefs::D, RegisterRefs::B);
+				break;
+			case MOV_D_C:
+				MOV(RegisterRefs::D, RegisterRefs::C);
+				break;
+			case MOV_D_D:
+				MOV(RegisterRefs::D, RegisterRefs::D);
+				break;
+			case MOV_D_E:
+				MOV(RegisterRefs::D, RegisterRefs::E);
+				break;
+			case MOV_D_H:
+				MOV(RegisterRefs::D, RegisterRefs::H);
+				break;
+			case MOV_D_L:
+				MOV(RegisterRefs::D, RegisterRefs::L);
+				break;
+			case MOV_D_M:
+				setRegister(RegisterRefs::D, readByte(getRegister(RegisterPairsRefs::HL)));
+				break;
+			case MOV_D_A:
+				MOV(RegisterRefs::D, RegisterRefs::A);
+				break;
+			case MOV_E_B:
+				MOV(RegisterRefs::E, RegisterRefs::B);
+				break;
+			case MOV_E_C:
+				MOV(RegisterRefs::E, RegisterRefs::C);
+				break;
+			case MOV_E_D:
+				MOV(RegisterRefs::E, RegisterRefs::D);
+				break;
+			case MOV_E_E:
+				MOV(RegisterRefs::E, RegisterRefs::E);
+				break;
+			case MOV_E_H:
+				MOV(RegisterRefs::E, RegisterRefs::H);
+				break;
+			case MOV_E_L:
+				MOV(RegisterRefs::E, RegisterRefs::L);
+				break;
+			case MOV_E_M:
+				setRegister(RegisterRefs::E, readByte(getRegister(RegisterPairsRefs::HL)));
+				break;
+			case MOV_E_A:
+				MOV(RegisterRefs::E, RegisterRefs::A);
+				break;
+
+			case MOV_H_B:
+				MOV(RegisterRefs::H, RegisterRefs::B);
+				break;
+			case MOV_H_C:
+				MOV(RegisterRefs::H, RegisterRefs::C);
+				break;
+			case MOV_H_D:
+				MOV(RegisterRefs::H, RegisterRefs::D);
+				break;
+			case MOV_H_E:
+				MOV(RegisterRefs::H, RegisterRefs::E);
+				break;
+			case MOV_H_H:
+				MOV(RegisterRefs::H, RegisterRefs::H);
+				break;
+			case MOV_H_L:
+				MOV(RegisterRefs::H, RegisterRefs::L);
+				break;
+			case MOV_H_M:
+				setRegister(RegisterRefs::H, readByte(getRegister(RegisterPairsRefs::HL)));
+				break;
+			case MOV_H_A:
+				MOV(RegisterRefs::H, RegisterRefs::A);
+				break;
+			case MOV_L_B:
+				MOV(RegisterRefs::L, RegisterRefs::B);
+				break;
+			case MOV_L_C:
+				MOV(RegisterRefs::L, RegisterRefs::C);
+				break;
+			case MOV_L_D:
+				MOV(RegisterRefs::L, RegisterRefs::D);
+				break;
+			case MOV_L_E:
+				MOV(RegisterRefs::L, RegisterRefs::E);
+				break;
+			case MOV_L_H:
+				MOV(RegisterRefs::L, RegisterRefs::H);
+				break;
+			case MOV_L_L:
+				MOV(RegisterRefs::L, RegisterRefs::L);
+				break;
+			case MOV_L_M:
+				setRegister(RegisterRefs::L, readByte(getRegister(RegisterPairsRefs::HL)));
+				break;
+			case MOV_L_A:
+				MOV(RegisterRefs::L, RegisterRefs::A);
+				break;
+
+			case MOV_M_B:
+				writeByte(getRegister(RegisterPairsRefs::HL), getRegister(RegisterRefs::B)); 
+				break;
+			case MOV_M_C:
+				writeByte(getRegister(RegisterPairsRefs::HL), getRegister(RegisterRefs::C));
+				break;
+			case MOV_M_D:
+				writeByte(getRegister(RegisterPairsRefs::HL), getRegister(RegisterRefs::D));
+				break;
+			case MOV_M_E:
+				writeByte(getRegister(RegisterPairsRefs::HL), getRegister(RegisterRefs::E));
+				break;
+			case MOV_M_H:
+				writeByte(getRegister(RegisterPairsRefs::HL), getRegister(RegisterRefs::H));
+				break;
+			case MOV_M_L:
+				writeByte(getRegister(RegisterPairsRefs::HL), getRegister(RegisterRefs::L));
+				break;
+			case HLT:
+				HALT = true;
+				break;
+			case MOV_M_A:
+				writeByte(getRegister(RegisterPairsRefs::HL), getRegister(RegisterRefs::A));
+				break;
+			case MOV_A_B:
+				MOV(RegisterRefs::A, RegisterRefs::B);
+				break;
+			case MOV_A_C:
+				MOV(RegisterRefs::A, RegisterRefs::C);
+				break;
+			case MOV_A_D:
+				MOV(RegisterRefs::A, RegisterRefs::D);
+				break;
+			case MOV_A_E:
+				MOV(RegisterRefs::A, RegisterRefs::E);
+				break;
+			case MOV_A_H:
+				MOV(RegisterRefs::A, RegisterRefs::H);
+				break;
+			case MOV_A_L:
+				MOV(RegisterRefs::A, RegisterRefs::L);
+				break;
+			case MOV_A_M:
+				setRegister(RegisterRefs::A, readByte(getRegister(RegisterPairsRefs::HL)));
+				break;
+			case MOV_A_A:
+				MOV(RegisterRefs::A, RegisterRefs::A);
+				break;
+
+			case ADD_B:
+				ALU<AluOp::ADD, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case ADD_C:
+				ALU<AluOp::ADD, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case ADD_D:
+				ALU<AluOp::ADD, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case ADD_E:
+				ALU<AluOp::ADD, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case ADD_H:
+				ALU<AluOp::ADD, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case ADD_L:
+				ALU<AluOp::ADD, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case ADD_M:
+				ALU<AluOp::ADD, AluSrc::M>();
+				break;
+			case ADD_A:
+				ALU<AluOp::ADD, AluSrc::REG, RegisterRefs::A>();
+				break;
+			case ADC_B:
+				ALU<AluOp::ADC, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case ADC_C:
+				ALU<AluOp::ADC, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case ADC_D:
+				ALU<AluOp::ADC, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case ADC_E:
+				ALU<AluOp::ADC, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case ADC_H:
+				ALU<AluOp::ADC, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case ADC_L:
+				ALU<AluOp::ADC, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case ADC_M:
+				ALU<AluOp::ADC, AluSrc::M>();
+				break;
+			case ADC_A:
+				ALU<AluOp::ADC, AluSrc::REG, RegisterRefs::A>();
+				break;
+
+			case SUB_B:
+				ALU<AluOp::SUB, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case SUB_C:
+				ALU<AluOp::SUB, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case SUB_D:
+				ALU<AluOp::SUB, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case SUB_E:
+				ALU<AluOp::SUB, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case SUB_H:
+				ALU<AluOp::SUB, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case SUB_L:
+				ALU<AluOp::SUB, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case SUB_M:
+				ALU<AluOp::SUB, AluSrc::M>();
+				break;
+			case SUB_A:
+				ALU<AluOp::SUB, AluSrc::REG, RegisterRefs::A>();
+				break;
+			case SBB_B:
+				ALU<AluOp::SBB, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case SBB_C:
+				ALU<AluOp::SBB, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case SBB_D:
+				ALU<AluOp::SBB, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case SBB_E:
+				ALU<AluOp::SBB, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case SBB_H:
+				ALU<AluOp::SBB, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case SBB_L:
+				ALU<AluOp::SBB, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case SBB_M:
+				ALU<AluOp::SBB, AluSrc::M>();
+				break;
+			case SBB_A:
+				ALU<AluOp::SBB, AluSrc::REG, RegisterRefs::A>();
+				break;
+
+			case ANA_B:
+				ALU<AluOp::ANA, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case ANA_C:
+				ALU<AluOp::ANA, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case ANA_D:
+				ALU<AluOp::ANA, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case ANA_E:
+				ALU<AluOp::ANA, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case ANA_H:
+				ALU<AluOp::ANA, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case ANA_L:
+				ALU<AluOp::ANA, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case ANA_M:
+				ALU<AluOp::ANA, AluSrc::M>();
+				break;
+			case ANA_A:
+				ALU<AluOp::ANA, AluSrc::REG, RegisterRefs::A>();
+				break;
+			case XRA_B:
+				ALU<AluOp::XRA, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case XRA_C:
+				ALU<AluOp::XRA, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case XRA_D:
+				ALU<AluOp::XRA, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case XRA_E:
+				ALU<AluOp::XRA, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case XRA_H:
+				ALU<AluOp::XRA, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case XRA_L:
+				ALU<AluOp::XRA, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case XRA_M:
+				ALU<AluOp::XRA, AluSrc::M>();
+				break;
+			case XRA_A:
+				ALU<AluOp::XRA, AluSrc::REG, RegisterRefs::A>();
+				break;
+
+			case ORA_B:
+				ALU<AluOp::ORA, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case ORA_C:
+				ALU<AluOp::ORA, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case ORA_D:
+				ALU<AluOp::ORA, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case ORA_E:
+				ALU<AluOp::ORA, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case ORA_H:
+				ALU<AluOp::ORA, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case ORA_L:
+				ALU<AluOp::ORA, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case ORA_M:
+				ALU<AluOp::ORA, AluSrc::M>();
+				break;
+			case ORA_A:
+				ALU<AluOp::ORA, AluSrc::REG, RegisterRefs::A>();
+				break;
+			case CMP_B:
+				ALU<AluOp::CMP, AluSrc::REG, RegisterRefs::B>();
+				break;
+			case CMP_C:
+				ALU<AluOp::CMP, AluSrc::REG, RegisterRefs::C>();
+				break;
+			case CMP_D:
+				ALU<AluOp::CMP, AluSrc::REG, RegisterRefs::D>();
+				break;
+			case CMP_E:
+				ALU<AluOp::CMP, AluSrc::REG, RegisterRefs::E>();
+				break;
+			case CMP_H:
+				ALU<AluOp::CMP, AluSrc::REG, RegisterRefs::H>();
+				break;
+			case CMP_L:
+				ALU<AluOp::CMP, AluSrc::REG, RegisterRefs::L>();
+				break;
+			case CMP_M:
+				ALU<AluOp::CMP, AluSrc::M>();
+				break;
+			case CMP_A:
+				ALU<AluOp::CMP, AluSrc::REG, RegisterRefs::A>();
+				break;
+
+			case RNZ:
+				Rcc(opcode);
+				break;
+			case POP_B:
+				POP_op(RegisterPairsRefs::BC);
+				break;
+			case JNZ_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case JMP_A16:
+				JMP(fetchWord(ref + 1));
+				break;
+			case CNZ_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case PUSH_B:
+				PUSH_op(RegisterPairsRefs::BC);
+				break;
+			case ADI_D8:
+				ALU<AluOp::ADD, AluSrc::IMM>();
+				break;
+			case RST_0:
+				RST(0);
+				break;
+			case RZ:
+				Rcc(opcode);
+				break;
+			case RET:
+				RET_op();
+				break;
+			case JZ_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case CZ_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case CALL_A16:
+				CALL(fetchWord(ref + 1));
+				break;
+			case ACI_D8:
+				ALU<AluOp::ADC, AluSrc::IMM>();
+				break;
+			case RST_1:
+				RST(1);
+				break;
+
+			case RNC:
+				Rcc(opcode);
+				break;
+			case POP_D:
+				POP_op(RegisterPairsRefs::DE);
+				break;
+			case JNC_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case OUT_D8:
+				OUT(fetch(ref + 1));
+				reg_PC++;
+				break;
+			case CNC_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case PUSH_D:
+				PUSH_op(RegisterPairsRefs::DE);
+				break;
+			case SUI_D8:
+				ALU<AluOp::SUB, AluSrc::IMM>();
+				break;
+			case RST_2:
+				RST(2);
+				break;
+			case RC:
+				Rcc(opcode);
+				break;
+			case JC_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case IN_D8:
+				IN(fetch(ref + 1));
+				reg_PC++;
+				break;
+			case CC_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case SBI_D8:
+				ALU<AluOp::SBB, AluSrc::IMM>();
+				break;
+			case RST_3:
+				RST(3);
+				break;
+		
+			case RPO:
+				Rcc(opcode);
+				break;
+			case POP_H:
+				POP_op(RegisterPairsRefs::HL);
+				break;
+			case JPO_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case CPO_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case XTHL:
+				XTHL_op();
+				break;
+			case PUSH_H:
+				PUSH_op(RegisterPairsRefs::HL);
+				break;
+			case ANI_D8:
+				ALU<AluOp::ANA, AluSrc::IMM>();
+				break;
+			case RST_4:
+				RST(4);
+				break;
+			case RPE:
+				Rcc(opcode);
+				break;
+			case PCHL:
+				PCHL_op();
+				break;
+			case JPE_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case XCHG:
+				temp = getRegister(RegisterPairsRefs::DE);
+				setRegisterPair(RegisterPairsRefs::DE, getRegister(RegisterPairsRefs::HL));
+				setRegisterPair(RegisterPairsRefs::HL, temp);
+				break;
+			case CPE_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case XRI_D8:
+				ALU<AluOp::XRA, AluSrc::IMM>();
+				break;
+			case RST_5:
+				RST(5);
+				break;
+
+			case RP:
+				Rcc(opcode);
+				break;
+			case POP_PSW:
+				POPpsw();
+				break;
+			case JP_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case DI:
+				INTE = false;
+				enablePending = false;
+				break;
+			case CP_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case PUSH_PSW:
+				PUSHpsw();
+				break;
+			case ORI_D8:
+				ALU<AluOp::ORA, AluSrc::IMM>();
+				break;
+			case RST_6:
+				RST(6);
+				break;
+			case RM:
+				Rcc(opcode);
+				break;
+			case SPHL:
+				SPHL_op();
+				break;
+			case JM_A16:
+				Jcc(opcode, fetchWord(ref + 1));
+				break;
+			case EI:
+				enablePending = true;
+				break;
+			case CM_A16:
+				Ccc(opcode, fetchWord(ref + 1));
+				break;
+			case CPI_D8:
+				ALU<AluOp::CMP, AluSrc::IMM>();
+				break;
+			case RST_7:
+				RST(7);
+				break;
+
+	        default:
+	            break;
+	    } 
+	}
+
+	// Executes one instruction (or services an interrupt), returns its T-states
+	int step(){
+		if(inputLog && inputLog->replaying()){
+			uint8_t vector;
+			if(inputLog->interruptDue(cycles, vector)){
+				interruptPending = true;
+				interruptVector = vector;
+			} 
+		} 
+		if(interruptPending && INTE)
+			return serviceInterrupt();
+
+		instructionPC = reg_PC;
+		if(pageFlags[reg_PC >> 8] & PAGE_NO_EXEC){
+			raiseFault(reg_PC, PERM_EXEC);
+			return 0;
+		} 
+		bool enable = enablePending;
+		uint8_t opcode = fetch(reg_PC);
+		int cost = opcodeCycles[opcode];
+		// Ccc is 11ccc100 and Rcc 11ccc000, the condition is decided before the flags change
+		if(((opcode & 0xC7) == 0xC0 || (opcode & 0xC7) == 0xC4) && conditionMet((opcode >> 3) & 7))
+			cost += 6;
+		portEvent = false;
+		getOperation();
+		reg_PC++;
+		setFlagReg();
+		instructions++;
+		if(enable){
+			INTE = true;
+			enablePending = false;
+		} 
+		cycles += cost;
+		return cost;
+	}
+	// Requests an interrupt from a device, vector 0-7 selects the RST
+	void interrupt(uint8_t vector){
+		if(inputLog && inputLog->replaying())
+			return;
+		interruptPending = true;
+		interruptVector = vector & 7;
+	}
+	// An interrupt will be serviced by the next step(), this also wakes a halted CPU
+	bool interruptReady(){
+		if(faulted)
+			return false;
+		if(inputLog && inputLog->replaying())
+			return INTE && inputLog->nextInterruptCycle() == cycles;
+		return INTE && interruptPending;
+	}
+	// During replay no device runs to wake a halted CPU or to move its clock on: the cycle of
+	// the logged interrupt it waits for, UINT64_MAX when there is none it could take
+	uint64_t replayWakeCycle(){
+		if(faulted || !INTE || !inputLog || !inputLog->replaying())
+			return UINT64_MAX;
+		uint64_t wake = inputLog->nextInterruptCycle();
+		return wake >= cycles ? wake : UINT64_MAX;
+	}
+	// RST vector: PC is pushed, interrupts are disabled and HLT is left
+	int serviceInterrupt(){
+		if(inputLog)
+			inputLog->recordInterrupt(cycles, interruptVector);
+		interruptPending = false;
+		INTE = false;
+		HALT = false;
+		interruptsTaken++;
+		instructionPC = reg_PC;
+		pushWord(reg_PC);
+		reg_PC = interruptVector * 8;
+		cycles += opcodeCycles[0xC7];
+		return opcodeCycles[0xC7];
+	}
+
+	// One dispatch of a superinstruction when one starts at PC and fits in the budget,
+	// otherwise a plain step(). Interrupts are only taken between dispatches.
+	int stepFused(uint64_t budget){
+		if(interruptPending || enablePending || inputLog)
+			return step();
+		uint16_t pc = reg_PC;
+		uint8_t kind = fusion[pc];
+		if(kind == FUSE_UNDECODED)
+			kind = decodeFusion(pc);
+		if(kind == FUSE_NONE || fusionTable[kind].cycles > budget)
+			return step();
+		// A refused read has to stop at its own instruction, not inside the sequence
+		if((kind == FUSE_MOV_A_M_INX_H || kind == FUSE_COMPARE_NEXT)
+		   && (pageFlags[reg_H] | pageFlags[static_cast<uint16_t>(getRegister(RegisterPairsRefs::HL) + 1) >> 8]) & PAGE_NO_READ)
+			return step();
+
+		portEvent = false;
+		uint8_t opcode = fetch(pc);
+		switch(kind){
+			case FUSE_DCR_JNZ:
+				DCR(static_cast<RegisterRefs>((opcode >> 3) & 7));
+				reg_PC = !flag_Z ? fetchWord(pc + 2) : pc + 4;
+				break;
+			case FUSE_MOV_A_M_INX_H:
+				setRegister(RegisterRefs::A, readByte(getRegister(RegisterPairsRefs::HL)));
+				INX(RegisterPairsRefs::HL);
+				reg_PC = pc + 2;
+				break;
+			case FUSE_CMP_JC:
+				aluKernel<AluOp::CMP>(getRegister(static_cast<RegisterRefs>(opcode & 7)));
+				reg_PC = flag_CY ? fetchWord(pc + 2) : pc + 4;
+				break;
+			case FUSE_CMP_JNC:
+				aluKernel<AluOp::CMP>(getRegister(static_cast<RegisterRefs>(opcode & 7)));
+				reg_PC = !flag_CY ? fetchWord(pc + 2) : pc + 4;
+				break;
+			case FUSE_LXI_MVI:
+				LXI(static_cast<RegisterPairsRefs>((opcode >> 4) & 3), fetch(pc + 2), fetch(pc + 1));
+				MVI(static_cast<RegisterRefs>((fetch(pc + 3) >> 3) & 7), fetch(pc + 4));
+				reg_PC = pc + 5;
+				break;
+			case FUSE_COMPARE_NEXT:
+				setRegister(RegisterRefs::A, readByte(getRegister(RegisterPairsRefs::HL)));
+				INX(RegisterPairsRefs::HL);
+				setRegister(RegisterRefs::B, readByte(getRegister(RegisterPairsRefs::HL)));
+				aluKernel<AluOp::CMP>(reg_B);
+				reg_PC = flag_CY ? fetchWord(pc + 5) : pc + 7;
+				break;
+		} 
+		setFlagReg();
+		fusionCounts[kind]++;
+		instructions += fusionTable[kind].instructions;
+		cycles += fusionTable[kind].cycles;
+		return fusionTable[kind].cycles;
+	}
+	uint16_t fetchWord(uint16_t address){
+		return static_cast<uint16_t>(fetch(address + 1) << 8 | fetch(address));
+	}
+	// Decodes and caches the superinstruction starting at address
+	uint8_t decodeFusion(uint16_t address){
+		uint8_t op[FUSION_MAX_LENGTH];
+		for(int i = 0; i < FUSION_MAX_LENGTH; i++)
+			op[i] = fetch(address + i);
+		setFusion(address, matchFusion(op));
+		return fusion[address];
+	}
+	// Stores a decoded entry, also used for entries decoded ahead of time from an image
+	void setFusion(uint16_t address, uint8_t kind){
+		if(kind != FUSE_NONE){
+			int first = address >> 8, last = static_cast<uint16_t>(address + fusionTable[kind].length - 1) >> 8;
+			// Instructions on a page without PERM_EXEC have to fault one by one. Bank storage
+			// can be written by other CPUs or the host without this one noticing.
+			if((pageFlags[first] | pageFlags[last]) & (PAGE_NO_EXEC | PAGE_BANKED))
+				kind = FUSE_NONE;
+			// Writes to the bytes of a fused sequence must drop it again, read-only pages
+			// cannot be written through the bus at all
+			if(kind != FUSE_NONE && !(pageFlags[first] & PAGE_NO_WRITE))
+				pageFlags[first] |= PAGE_CODE;
+			if(kind != FUSE_NONE && !(pageFlags[last] & PAGE_NO_WRITE))
+				pageFlags[last] |= PAGE_CODE;
+		} 
+		fusion[address] = kind;
+		fusionPages[address >> 8] = true;
+	}
+	void invalidateFusion(uint16_t address){
+		for(int i = 0; i < FUSION_MAX_LENGTH; i++)
+			fusion[static_cast<uint16_t>(address - i)] = FUSE_UNDECODED;
+	}
+	void clearFusionPage(int page){
+		if(!fusionPages[page] && !(pageFlags[page] & PAGE_CODE))
+			return;
+		// Sequences starting at the end of the previous page can reach into this one
+		for(int i = 0; i < 0x100 + FUSION_MAX_LENGTH; i++)
+			fusion[static_cast<uint16_t>((page << 8) - FUSION_MAX_LENGTH + i)] = FUSE_UNDECODED;
+		pageFlags[page] &= ~PAGE_CODE;
+		fusionPages[page] = false;
+	}
+	// Drops every decoded sequence, for when the host rewrites memory behind the bus
+	void clearFusion(){
+		for(int page = 0; page < 0x100; page++)
+			clearFusionPage(page);
+	}
+	void printFusionStats(LogLevel level = LOG_INFO){
+		for(int kind = FUSE_DCR_JNZ; kind < FUSE_COUNT; kind++){
+			if(!fusionCounts[kind])
+				continue;
+			uint64_t saved = fusionCounts[kind] * (fusionTable[kind].instructions - 1);
+			logger().record(level, "fusion", {{"sequence", 0, 0, fusionTable[kind].name}, {"count", fusionCounts[kind]}, {"saved_dispatches", saved}});
+		} 
+	}
+
+	// ccc field of conditional jumps, calls and returns: NZ Z NC C PO PE P M. Each selects a
+	// PSW bit, odd codes need it set and even codes need it clear.
+	bool conditionMet(uint8_t condition){
+		static constexpr uint8_t conditionFlag[8] = {0x40, 0x40, 0x01, 0x01, 0x04, 0x04, 0x80, 0x80};
+		return ((reg_FLAGS & conditionFlag[condition]) != 0) == (condition & 1);
+	}
+
+	RunResult run_for(uint64_t nCycles){
+		StopCondition condition;
+		condition.maxCycles = nCycles;
+		return run_until(condition);
+	}
+
+	// run_for() in slices until a limit of the watchdog runs out or the CPU stops on its own.
+	// Every instruction takes at least 4 T-states, so a slice is cut short enough not to run past
+	// the instruction budget. The CPU is left as it was at the stop, ready for a report.
+	RunResult run_limited(const RunLimits& limits){
+		auto started = std::chrono::steady_clock::now();
+		uint64_t startCycles = cycles, startInstructions = instructions;
+		RunResult result;
+		while(true){
+			uint64_t ran = cycles - startCycles, executed = instructions - startInstructions;
+			uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+			StopReason limit = limits.exceeded(ran, executed, elapsed);
+			if(limit != StopReason::NONE){
+				result.reason = limit;
+				break;
+			} 
+			uint64_t slice = std::min(std::max<uint64_t>(limits.sliceCycles, 1), limits.maxCycles - ran);
+			uint64_t remaining = limits.maxInstructions - executed;
+			if(remaining < UINT64_MAX / 4)
+				slice = std::min(slice, remaining * 4);
+			result = run_for(slice);
+			if(limits.onSlice)
+				limits.onSlice(*this);
+			if(result.reason != StopReason::CYCLE_BUDGET)
+				break;
+		} 
+		result.cycles = cycles - startCycles;
+		result.pc = reg_PC;
+		return result;
+	}
+
+	RunResult run_until(const StopCondition& condition){
+		if(debugActive())
+			return runLoop<true>(condition, nullptr);
+		return runLoop<false>(condition, nullptr);
+	}
+
+	RunResult run_until(const std::function<bool(const CPU&)>& predicate, uint64_t maxCycles = UINT64_MAX){
+		StopCondition condition;
+		condition.maxCycles = maxCycles;
+		if(debugActive())
+			return runLoop<true>(condition, &predicate);
+		return runLoop<false>(condition, &predicate);
+	}
+
+	// Shared run loop. The debug instantiation is only used while breakpoints or watchpoints
+	// are set, so the plain one carries no debugger checks at all.
+	template<bool debug>
+	RunResult runLoop(const StopCondition& condition, const std::function<bool(const CPU&)>* predicate){
+		RunResult result;
+		uint64_t start = cycles;
+		uint8_t watched = condition.watchAddress >= 0 ? peekByte(condition.watchAddress) : 0;
+		int armedPage = -1;
+		bool pageArmed = false;
+		if constexpr (!debug)
+			resumeBreakpoint = -1;
+		// Fused sequences would step over PC and memory stop conditions
+		bool fuse = !debug && fuseInstructions && condition.pc < 0 && condition.watchAddress < 0 && !predicate;
+
+		while(true){
+			result.cycles = cycles - start;
+			result.pc = reg_PC;
+			if(HALT && !interruptReady()){
+				// Replay idles up to the logged interrupt, as the recording host did
+				uint64_t wake = replayWakeCycle();
+				if(wake != UINT64_MAX){
+					if(wake - start < condition.maxCycles){
+						cycles = wake;
+						continue;
+					} 
+					cycles = start + condition.maxCycles;
+					result.cycles = condition.maxCycles;
+					result.reason = StopReason::CYCLE_BUDGET;
+					return result;
+				} 
+				result.reason = faulted ? StopReason::PROTECTION_FAULT : StopReason::HALTED;
+				if(faulted){
+					result.address = fault.address;
+					result.access = fault.access;
+				} 
+				return result;
+			} 
+			if(result.cycles >= condition.maxCycles){
+				result.reason = StopReason::CYCLE_BUDGET;
+				return result;
+			} 
+
+			if constexpr (debug) {
+				// Breakpoint state is reloaded only when execution enters another page,
+				// pages without breakpoints never test the bitmap. Only the breakpoint the last
+				// run stopped at is passed over once, so it can be continued while a run that
+				// merely starts on a breakpoint (e.g. the next slice) still reports it.
+				if((reg_PC >> 8) != armedPage){
+					armedPage = reg_PC >> 8;
+					pageArmed = breakpointPages[armedPage] != 0;
+				} 
+				if(pageArmed && reg_PC != resumeBreakpoint && isBreakpoint(reg_PC)){
+					resumeBreakpoint = reg_PC;
+					result.reason = StopReason::BREAKPOINT;
+					result.address = reg_PC;
+					return result;
+				} 
+				resumeBreakpoint = -1;
+				watchHit = false;
+			} 
+
+			if(fuse)
+				stepFused(condition.maxCycles - result.cycles);
+			else
+				step();
+			result.cycles = cycles - start;
+			result.pc = reg_PC;
+
+			if constexpr (debug) {
+				if(watchHit){
+					result.reason = StopReason::WATCHPOINT;
+					result.address = watchHitAddress;
+					result.access = watchHitType;
+					return result;
+				} 
+			} 
+			if(condition.pc >= 0 && reg_PC == condition.pc){
+				result.reason = StopReason::PC_MATCH;
+				result.address = reg_PC;
+				return result;
+			} 
+			if(condition.watchAddress >= 0 && peekByte(condition.watchAddress) != watched){
+				result.reason = StopReason::MEMORY_WATCH;
+				result.address = condition.watchAddress;
+				return result;
+			} 
+			if(condition.port >= 0 && portEvent && (condition.port == StopCondition::ANY_PORT || condition.port == lastPort)){
+				result.reason = StopReason::PORT_EVENT;
+				result.address = lastPort;
+				return result;
+			} 
+			if(predicate && (*predicate)(*this)){
+				result.reason = StopReason::PREDICATE;
+				return result;
+			} 
+		} 
+	}
+
+	// Power-on state of registers, flags, memory and ports. Attached devices, debugger
+	// settings, MMIO regions and bank windows are kept.
+	void reset(){
+		std::fill(std::begin(memory), std::end(memory), 0);
+		clearFusion();
+		if(baseline)
+			markDirty(0x0000, 0x10000);
+		resetRegisters();
+	}
+
+	// Takes the current memory as the state resetToBaseline() goes back to
+	void setBaseline(){
+		if(!baseline)
+			baseline.reset(new uint8_t[0x10000]);
+		std::copy(std::begin(memory), std::end(memory), baseline.get());
+		std::fill(std::begin(dirtyPages), std::end(dirtyPages), 0);
+		for(uint16_t& flags : pageFlags)
+			flags |= PAGE_CLEAN;
+	}
+	// reset() to the baseline memory instead of zeros. Only pages written since the baseline
+	// or the last resetToBaseline() are copied back, superinstructions decoded from the other
+	// pages stay valid. Bank stores are not part of the baseline.
+	void resetToBaseline(){
+		if(!baseline)
+			return reset();
+		for(int word = 0; word < 0x100 / 64; word++){
+			for(uint64_t bits = dirtyPages[word]; bits; bits &= bits - 1){
+				int page = word * 64 + __builtin_ctzll(bits);
+				std::copy(&baseline[page << 8], &baseline[page << 8] + 0x100, &memory[page << 8]);
+				clearFusionPage(page);
+				pageFlags[page] |= PAGE_CLEAN;
+			} 
+			dirtyPages[word] = 0;
+		} 
+		resetRegisters();
+	}
+	// Host writes straight into memory[] bypass the bus and must be reported here
+	void markDirty(uint16_t start, uint32_t size){
+		if(!size)
+			return;
+		for(uint32_t page = start >> 8; page <= (start + size - 1) >> 8 && page < 0x100; page++)
+			markPageDirty(page);
+	}
+	void markPageDirty(int page){
+		dirtyPages[page >> 6] |= 1ULL << (page & 63);
+		pageFlags[page] &= ~PAGE_CLEAN;
+	}
+	// markDirty() for host writes over memory that may already have run, also drops the
+	// superinstructions decoded from the old bytes
+	void hostWrote(uint16_t start, uint32_t size){
+		if(!size)
+			return;
+		markDirty(start, size);
+		for(uint32_t page = start >> 8; page <= (start + size - 1) >> 8 && page < 0x100; page++)
+			clearFusionPage(page);
+	}
+
+	// Power-on state of everything but memory
+	void resetRegisters(){
+		reg_A = reg_B = reg_C = reg_D = reg_E = reg_H = reg_L = 0;
+		reg_SP = reg_PC = 0;
+		reg_FLAGS = 0;
+		loadFlagReg();
+		clearPort();
+		HALT = faulted = false;
+		cyclesBeforeReset += cycles;
+		cycles = 0;
+		INTE = enablePending = interruptPending = false;
+		interruptVector = 0;
+		lastPort = 0;
+		portEvent = watchHit = false;
+		resumeBreakpoint = -1;
+	}
+	void clearPort(){
+		for(uint16_t i = 0; i < sizeof(ports); i++){
+			ports[i] = 0x00;  
+		};
+	} 
+
+	void printRegisters(LogLevel level = LOG_INFO){
+		Logger& log = logger();
+		if(!log.enabled(level))
+			return;
+		auto lock = log.lock();
+		if(log.getFormat() != LOG_TEXT){
+			log.record(level, "registers", {
+				{"a", reg_A, 2}, {"b", reg_B, 2}, {"c", reg_C, 2}, {"d", reg_D, 2}, {"e", reg_E, 2},
+				{"h", reg_H, 2}, {"l", reg_L, 2}, {"sp", reg_SP, 4}, {"pc", reg_PC, 4}, {"flags", reg_FLAGS, 2},
+				{"cycles", cycles}
+			});
+			return;
+		} 
+		log.put("Accumulator register : ").endLine();
+		printRegisterLine("A", reg_A, 8);
+		log.endLine();
+		log.put("General purpose registers : ").endLine();
+		printRegisterLine("B", reg_B, 8);
+		printRegisterLine("C", reg_C, 8);
+		printRegisterLine("D", reg_D, 8);
+		printRegisterLine("E", reg_E, 8);
+		printRegisterLine("H", reg_H, 8);
+		printRegisterLine("L", reg_L, 8);
+		log.endLine();
+		log.put("Register pairs : ").endLine();
+		printRegisterLine("BC", getRegister(BC), 16);
+		printRegisterLine("DE", getRegister(DE), 16);
+		printRegisterLine("HL", getRegister(HL), 16);
+		log.endLine();
+		log.put("System registers : ").endLine();
+		printRegisterLine("SP", getRegister(SP), 16);
+		printRegisterLine("PC", getRegister(PC), 16);
+		printRegisterLine("FLAGS", getRegister(FLAGS), 8);
+		log.put("T-states : ").dec(cycles).endLine();
+	}
+	// "B : 00000101 - 0x05"
+	void printRegisterLine(const char* name, uint16_t value, int bits){
+		logger().put(name).put(" : ").bin(value, bits).put(" - 0x").hex(value, bits / 4).endLine();
+	}
+
+	// Register state and a dump of the watched memory regions only, for breakpoint/watchpoint stops
+	void printStopReport(const RunResult& result){
+		Logger& log = logger();
+		auto lock = log.lock();
+		bool io = false;
+		for(const Watchpoint& watch : watchpoints)
+			io |= watch.io && (watch.type & result.access) && result.address >= watch.start && result.address <= watch.end;
+
+		if(log.getFormat() != LOG_TEXT){
+			log.record(LOG_INFO, "stop", {
+				{"reason", 0, 0, stopReasonName(result.reason)}, {"pc", result.pc, 4},
+				{"address", result.address, 4}, {"access", result.access}, {"io", io}, {"cycles", result.cycles}
+			});
+		} else if(result.reason == StopReason::BREAKPOINT){
+			log.put("Breakpoint at 0x").hex(result.address, 4).endLine();
+		} else if(result.reason == StopReason::WATCHPOINT){
+			log.put("Watchpoint ").put(result.access == WATCH_WRITE ? (io ? "OUT" : "write") : (io ? "IN" : "read"))
+			   .put(" at 0x").hex(result.address, 4).put(" (PC 0x").hex(result.pc, 4).put(")").endLine();
+		} else if(result.reason == StopReason::PROTECTION_FAULT){
+			log.put("Protection fault: ").put(fault.access == PERM_WRITE ? "write" : fault.access == PERM_READ ? "read" : "execute")
+			   .put(" at 0x").hex(fault.address, 4).put(" (PC 0x").hex(fault.pc, 4).put(")").endLine();
+		} else if(result.reason == StopReason::CYCLE_BUDGET || result.reason == StopReason::INSTRUCTION_BUDGET || result.reason == StopReason::DEADLINE){
+			log.put("Stopped by watchdog: ").put(stopReasonName(result.reason)).put(" at PC 0x").hex(result.pc, 4)
+			   .put(" after ").dec(result.cycles).put(" T-states").endLine();
+		} 
+		printRegisters();
+		for(const Watchpoint& watch : watchpoints){
+			if(watch.io){
+				log.record(LOG_INFO, "port", {{"port", watch.start, 2}, {"value", ports[watch.start], 2}});
+				continue;
+			} 
+			int first = watch.start & ~0xF;
+			int last = std::min<int>((watch.end | 0xF) + 1, sizeof(memory));
+			printAddressArray(memory + first, last - first, first);
+		} 
+	}  
+};
+
+// Copies a program image to memory at offset, truncated at the end of memory. Returns the
+// number of bytes loaded.
+inline size_t loadProgramFromBytes(const uint8_t data[], size_t size, uint8_t memory[], size_t memorySize, uint16_t offset){
+	if(offset >= memorySize)
+		return 0;
+	size_t count = std::min(size, memorySize - offset);
+	std::copy(data, data + count, memory + offset);
+	return count;
+}
+
+// Hex digits and printable characters of one 16-byte dump line. With SSE2 both columns are
+// built with a handful of vector ops: nibbles become '0'+n, plus 7 where n > 9, and the ASCII
+// column keeps bytes in 0x20..0x7E and replaces the rest with '.'.
+inline void formatDumpChunk(const uint8_t bytes[16], char hex[32], char ascii[16]) {
+#if defined(__SSE2__)
+	__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+	__m128i low = _mm_and_si128(data, _mm_set1_epi8(0x0F));
+	__m128i high = _mm_and_si128(_mm_srli_epi16(data, 4), _mm_set1_epi8(0x0F));
+	auto digits = [](__m128i nibbles) {
+		__m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('A' - '0' - 10));
+		return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+	};
+	__m128i highDigits = digits(high), lowDigits = digits(low);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(hex), _mm_unpacklo_epi8(highDigits, lowDigits));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), _mm_unpackhi_epi8(highDigits, lowDigits));
+
+	// Signed compares: 0x80..0xFF are negative and fail the > 0x1F test
+	__m128i printable = _mm_andnot_si128(_mm_cmpeq_epi8(data, _mm_set1_epi8(0x7F)), _mm_cmpgt_epi8(data, _mm_set1_epi8(0x1F)));
+	__m128i text = _mm_or_si128(_mm_and_si128(printable, data), _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(ascii), text);
+#else
+	for (int i = 0; i < 16; ++i) {
+		Logger::writeHex(hex + i * 2, bytes[i], 2);
+		ascii[i] = (bytes[i] >= 0x20 && bytes[i] < 0x7F) ? static_cast<char>(bytes[i]) : '.';
+	}
+#endif
+}
+
+// Hex dump, 16 bytes per line with an ASCII column. Runs of identical lines are collapsed
+// into a single "*" (a "repeat" record in JSON/CSV), repeats are found on the raw bytes
+// before anything gets formatted.
+inline void printAddressArray(uint8_t address[], int addressSize, int baseAddress, LogLevel level) {
+	Logger& log = logger();
+	if(!log.enabled(level))
+		return;
+	auto lock = log.lock();
+
+	const int bytesPerLine = 16;
+	const uint8_t* previous = nullptr;
+	int repeated = 0;
+	bool text = log.getFormat() == LOG_TEXT;
+	char hex[bytesPerLine * 2 + 1];
+	char ascii[bytesPerLine];
+	char line[bytesPerLine * 3 + 1 + bytesPerLine];
+	memset(line, ' ', sizeof(line));
+
+	for (int i = 0; i < addressSize; i += bytesPerLine) {
+		const uint8_t* chunk = address + i;
+		int count = std::min(bytesPerLine, addressSize - i);
+
+		// Previous line comparison, a short last line never repeats a full one
+		if (previous && count == bytesPerLine && memcmp(chunk, previous, bytesPerLine) == 0) {
+			if (repeated++ == 0 && text)
+				log.put('*').endLine(level);
+			continue;
+		}
+		if (repeated && !text)
+			log.record(level, "repeat", {{"address", static_cast<uint64_t>(baseAddress + i - repeated * bytesPerLine), 6}, {"lines", static_cast<uint64_t>(repeated)}});
+		repeated = 0;
+
+		if (count == bytesPerLine) {
+			formatDumpChunk(chunk, hex, ascii);
+		} else {
+			uint8_t tail[bytesPerLine] = {};
+			memcpy(tail, chunk, count);
+			formatDumpChunk(tail, hex, ascii);
+		}
+
+		if (text) {
+			// Building HEX and ASCII line, the separators are already in place
+			for (int j = 0; j < count; ++j)
+				memcpy(line + j * 3, hex + j * 2, 2);
+			for (int j = count; j < bytesPerLine; ++j)
+				memcpy(line + j * 3, "  ", 2);
+			memcpy(line + bytesPerLine * 3 + 1, ascii, count);
+			log.hex(baseAddress + i, 6).put("  ").put(line, bytesPerLine * 3 + 1 + count).endLine(level);
+		} else {
+			hex[count * 2] = 0;
+			log.record(level, "memory", {{"address", static_cast<uint64_t>(baseAddress + i), 6}, {"bytes", 0, 0, hex}});
+		}
+		previous = chunk;
+	}
+	if (repeated && !text)
+		log.record(level, "repeat", {{"address", static_cast<uint64_t>(baseAddress + addressSize - repeated * bytesPerLine), 6}, {"lines", static_cast<uint64_t>(repeated)}});
+}
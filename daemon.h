@@ -0,0 +1,484 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "imagecache.h"
+#include "transcache.h"
+#include "perfcounters.h"
+
+// Job server on a local Unix socket. Clients send line based jobs, each one runs on a CPU
+// from a pool created at startup and the results are streamed back as soon as a job is done,
+// tagged with its id (jobs of one connection can finish out of order).
+//
+//   IMAGE <name> <addr> <hex>     keep a program image for later jobs (outside a job)
+//   JOB <id>                      start a job
+//   USE <name>                    load a kept image
+//   LOAD <addr> <hex>             load program bytes
+//   POKE <addr> <hex>             patch memory after loading
+//   PC <addr>                     start address (default 0)
+//   BUDGET <cycles>               T-state budget (default 1000000)
+//   INSTRUCTIONS <count>          instruction budget (default none)
+//   TIMEOUT <ms>                  wall-clock limit, decimal (default 10000)
+//   PROTECT <addr> <length> <rwx> page permissions, e.g. r-x for ROM (default rwx)
+//   OUTPUT REGS|PORTS|MEM <addr> <length>
+//   RUN                           queue the job
+//
+// Replies: RESULT <id> <stop reason> cycles=<n> instructions=<n> pc=<addr> (plus fault=<addr>
+// access=r|w|x at=<instruction> after a protection fault), then REGS/PORTS/MEM <id> ... lines
+// for the requested outputs, DONE <id>. A job stopped by one of its limits always gets REGS.
+// Jobs still queued when the server stops get ERROR <id> server stopping. A line longer than
+// MAX_LINE closes the connection. A malformed job gets ERROR <id> <message>.
+// Numbers are hex except cycle counts, hex data is two digits per byte.
+class JobServer {
+public:
+	static constexpr uint64_t DEFAULT_BUDGET = 1000000;
+	static constexpr uint64_t DEFAULT_TIMEOUT_MS = 10000;
+	static constexpr size_t MAX_LINE = 0x20000 + 256;		// a full 64 KB LOAD line in hex
+	static constexpr uint64_t COUNTER_SLICE = 1000000;		// T-states between counter and deadline checks
+
+	// Where the decoded sequences of kept images are saved between runs, none when empty
+	std::string translationDirectory;
+	// Shared memory counters, worker i publishes to <countersName>.<i>, none when empty
+	std::string countersName;
+
+	explicit JobServer(int workerCount = 0){
+		if(workerCount <= 0)
+			workerCount = std::max(1u, std::thread::hardware_concurrency());
+		// Pre-warmed pool: every CPU is allocated and touched once before the first job, jobs
+		// then start from the cleared state by undoing only the pages the last job wrote
+		for(int i = 0; i < workerCount; i++){
+			cpus.emplace_back(new CPU());
+			cpus.back()->reset();
+			cpus.back()->setBaseline();
+		}
+	}
+	~JobServer(){
+		stop();
+	}
+
+	bool listenUnix(const std::string& path){
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd < 0)
+			return false;
+
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+		unlink(path.c_str());
+		if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, 16) < 0){
+			close(fd);
+			return false;
+		}
+		listenFd = fd;
+		unixPath = path;
+		return true;
+	}
+
+	// Serves until stop(), accepting connections on the calling thread
+	void run(){
+		for(size_t i = 0; i < cpus.size(); i++)
+			workers.emplace_back([this, i](){ workerLoop(*cpus[i], i); });
+		while(!quit){
+			int fd = accept(listenFd, nullptr, nullptr);
+			if(fd < 0)
+				break;
+			// Connection readers run until their client hangs up or stop() shuts them down
+			std::lock_guard<std::mutex> lock(readersMutex);
+			reapReaders();
+			readers.emplace_back();
+			Reader& reader = readers.back();
+			auto connection = std::make_shared<Connection>(fd);
+			reader.connection = connection;
+			// The socket closes once the reader and the connection's last job are done
+			reader.thread = std::thread([this, &reader, connection]() mutable {
+				readLoop(std::move(connection));
+				reader.done = true;
+			});
+		}
+		stop();
+	}
+
+	// Lets running jobs finish and rejects the queued ones, then closes every connection
+	void stop(){
+		if(quit.exchange(true))
+			return;
+		if(listenFd >= 0)
+			shutdown(listenFd, SHUT_RDWR);
+		std::deque<Job> rejected;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			rejected.swap(queue);
+		}
+		for(const Job& job : rejected)
+			job.connection->send("ERROR " + job.id + " server stopping\n");
+		queueReady.notify_all();
+		for(std::thread& worker : workers)
+			worker.join();
+		workers.clear();
+		{
+			std::lock_guard<std::mutex> lock(readersMutex);
+			for(Reader& reader : readers)
+				if(auto connection = reader.connection.lock())
+					shutdown(connection->fd, SHUT_RDWR);
+			for(Reader& reader : readers)
+				reader.thread.join();
+			readers.clear();
+		}
+		if(listenFd >= 0)
+			close(listenFd);
+		listenFd = -1;
+		if(!unixPath.empty())
+			unlink(unixPath.c_str());
+		for(CPU* cpu : cpus)
+			delete cpu;
+		cpus.clear();
+	}
+
+private:
+	struct Connection {
+		explicit Connection(int fd) : fd(fd) {}
+		~Connection(){
+			close(fd);
+		}
+		void send(const std::string& text){
+			std::lock_guard<std::mutex> lock(mutex);
+			size_t sent = 0;
+			while(sent < text.size()){
+				ssize_t count = ::send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+				if(count <= 0)
+					return;
+				sent += count;
+			}
+		}
+		int fd;
+		std::mutex mutex;
+	};
+
+	struct Segment {
+		uint16_t address;
+		std::shared_ptr<const std::vector<uint8_t>> bytes;
+		ImageRef image;		// kept images, attached with their decoded sequences
+	};
+	struct MemoryOutput {
+		uint16_t address;
+		uint32_t length;
+	};
+	struct Protection {
+		uint16_t address;
+		uint32_t length;
+		uint8_t permissions;
+	};
+	struct Job {
+		std::string id;
+		std::vector<Segment> segments;		// images and loads, then pokes, in order
+		uint16_t pc = 0;
+		uint64_t budget = DEFAULT_BUDGET;
+		uint64_t instructions = UINT64_MAX;
+		uint64_t timeoutMillis = DEFAULT_TIMEOUT_MS;
+		bool registers = false;
+		bool ports = false;
+		std::vector<MemoryOutput> memory;
+		std::vector<Protection> protections;
+		std::shared_ptr<Connection> connection;
+	};
+
+	struct Reader {
+		std::weak_ptr<Connection> connection;
+		std::thread thread;
+		std::atomic<bool> done{false};
+	};
+
+	std::vector<CPU*> cpus;
+	std::vector<std::thread> workers;
+	std::list<Reader> readers;		// one per connection, finished ones are joined on the next accept
+	std::mutex readersMutex;
+	std::atomic<bool> quit{false};
+	int listenFd = -1;
+	std::string unixPath;
+
+	std::deque<Job> queue;
+	std::mutex queueMutex;
+	std::condition_variable queueReady;
+
+	// Kept images by name, entries of the process-wide image cache
+	std::map<std::string, ImageRef> images;
+	std::map<uint64_t, std::unique_ptr<TranslationCache>> translations;	// by image hash
+	std::mutex imageMutex;
+
+	void readLoop(std::shared_ptr<Connection> connection){
+		std::string pending;
+		char buffer[65536];
+		Job job;
+		bool inJob = false;
+		std::string error;
+		while(true){
+			ssize_t count = recv(connection->fd, buffer, sizeof(buffer), 0);
+			if(count <= 0)
+				return;
+			pending.append(buffer, count);
+			size_t start = 0, end;
+			while((end = pending.find('\n', start)) != std::string::npos){
+				std::string line = pending.substr(start, end - start);
+				start = end + 1;
+				if(!line.empty() && line.back() == '\r')
+					line.pop_back();
+				std::istringstream words(line);
+				std::string command;
+				words >> command;
+
+				if(command == "JOB"){
+					job = Job();
+					words >> job.id;
+					job.connection = connection;
+					inJob = true;
+					error.clear();
+				} else if(command == "IMAGE" && !inJob){
+					std::string name, hex;
+					unsigned address;
+					std::vector<uint8_t> bytes;
+					if(words >> name >> std::hex >> address >> hex && address <= 0xFFFF && decodeHex(hex, bytes)){
+						ImageRef image = imageCache().get(bytes.data(), bytes.size(), static_cast<uint16_t>(address));
+						std::lock_guard<std::mutex> lock(imageMutex);
+						images[name] = image;
+						if(!translationDirectory.empty() && !translations.count(image->hash)){
+							translations[image->hash].reset(new TranslationCache(image->hash));
+							translations[image->hash]->open(translationDirectory);
+						} 
+					} else {
+						connection->send("ERROR - bad IMAGE line\n");
+					}
+				} else if(!inJob){
+					if(!command.empty())
+						connection->send("ERROR - " + command + " outside a job\n");
+				} else if(!error.empty()){
+					// Rest of a bad job is skipped up to its RUN
+					if(command == "RUN"){
+						connection->send("ERROR " + job.id + " " + error + "\n");
+						inJob = false;
+					}
+				} else if(command == "RUN"){
+					std::unique_lock<std::mutex> lock(queueMutex);
+					if(quit){
+						lock.unlock();
+						connection->send("ERROR " + job.id + " server stopping\n");
+					} else {
+						queue.push_back(std::move(job));
+						lock.unlock();
+						queueReady.notify_one();
+					} 
+					inJob = false;
+				} else {
+					error = parseJobLine(command, words, job);
+				}
+			}
+			pending.erase(0, start);
+			if(pending.size() > MAX_LINE){
+				connection->send("ERROR - line too long\n");
+				shutdown(connection->fd, SHUT_RDWR);
+				return;
+			} 
+		}
+	}
+
+	void reapReaders(){
+		for(auto reader = readers.begin(); reader != readers.end(); ){
+			if(reader->done){
+				reader->thread.join();
+				reader = readers.erase(reader);
+			} else {
+				reader++;
+			}
+		} 
+	}
+
+	// Adds one line to a job, returns an error message or ""
+	std::string parseJobLine(const std::string& command, std::istringstream& words, Job& job){
+		if(command == "USE"){
+			std::string name;
+			words >> name;
+			std::lock_guard<std::mutex> lock(imageMutex);
+			auto image = images.find(name);
+			if(image == images.end())
+				return "unknown image " + name;
+			job.segments.push_back({image->second->address, nullptr, image->second});
+		} else if(command == "LOAD" || command == "POKE"){
+			unsigned address;
+			std::string hex;
+			std::vector<uint8_t> bytes;
+			if(!(words >> std::hex >> address >> hex) || address > 0xFFFF || !decodeHex(hex, bytes))
+				return "bad " + command + " line";
+			job.segments.push_back({static_cast<uint16_t>(address), std::make_shared<const std::vector<uint8_t>>(std::move(bytes)), nullptr});
+		} else if(command == "PC"){
+			unsigned address;
+			if(!(words >> std::hex >> address) || address > 0xFFFF)
+				return "bad PC line";
+			job.pc = address;
+		} else if(command == "BUDGET"){
+			if(!(words >> std::dec >> job.budget))
+				return "bad BUDGET line";
+		} else if(command == "INSTRUCTIONS"){
+			if(!(words >> std::dec >> job.instructions))
+				return "bad INSTRUCTIONS line";
+		} else if(command == "TIMEOUT"){
+			if(!(words >> std::dec >> job.timeoutMillis) || job.timeoutMillis > UINT64_MAX / 1000000)
+				return "bad TIMEOUT line";
+		} else if(command == "PROTECT"){
+			unsigned address, length;
+			std::string rights;
+			uint8_t permissions;
+			if(!(words >> std::hex >> address >> length >> rights) || address > 0xFFFF || !parsePermissions(rights, permissions))
+				return "bad PROTECT line";
+			job.protections.push_back({static_cast<uint16_t>(address), length, permissions});
+		} else if(command == "OUTPUT"){
+			std::string what;
+			words >> what;
+			if(what == "REGS"){
+				job.registers = true;
+			} else if(what == "PORTS"){
+				job.ports = true;
+			} else if(what == "MEM"){
+				unsigned address, length;
+				if(!(words >> std::hex >> address >> length) || address > 0xFFFF || length > 0x10000)
+					return "bad OUTPUT MEM line";
+				job.memory.push_back({static_cast<uint16_t>(address), length});
+			} else {
+				return "unknown output " + what;
+			}
+		} else {
+			return "unknown command " + command;
+		}
+		return "";
+	}
+
+	TranslationCache* translationsFor(uint64_t hash){
+		std::lock_guard<std::mutex> lock(imageMutex);
+		auto cache = translations.find(hash);
+		return cache != translations.end() ? cache->second.get() : nullptr;
+	}
+
+	void workerLoop(CPU& cpu, size_t index){
+		PerfExporter counters;
+		if(!countersName.empty())
+			counters.open(countersName + "." + std::to_string(index));
+		while(true){
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueReady.wait(lock, [this](){ return quit || !queue.empty(); });
+				if(quit)
+					return;
+				job = std::move(queue.front());
+				queue.pop_front();
+			}
+			job.connection->send(runJob(cpu, job, counters));
+		}
+	}
+
+	std::string runJob(CPU& cpu, const Job& job, PerfExporter& counters){
+		cpu.resetToBaseline();
+		std::vector<TranslationCache*> used;
+		for(const Segment& segment : job.segments){
+			if(segment.image){
+				attachImage(cpu, *segment.image);
+				if(TranslationCache* cache = translationsFor(segment.image->hash))
+					used.push_back(cache);
+			} else {
+				// Raw bytes can land on pre-decoded code, pokeByte() drops what they overlap
+				for(size_t i = 0; i < segment.bytes->size() && segment.address + i <= 0xFFFF; i++)
+					cpu.pokeByte(static_cast<uint16_t>(segment.address + i), (*segment.bytes)[i]);
+			} 
+		} 
+		// Permissions of the last job do not carry over, loading is not subject to them
+		cpu.protect(0x0000, 0x10000, PERM_ALL);
+		for(const Protection& protection : job.protections)
+			cpu.protect(protection.address, protection.length, protection.permissions);
+		// Records only apply to pages that ended up the same as when they were saved
+		for(TranslationCache* cache : used)
+			cache->apply(cpu);
+		cpu.reg_PC = job.pc;
+		// Long jobs are cut into slices so the counters stay live and a runaway program is
+		// stopped by its deadline instead of holding the worker
+		RunLimits limits;
+		limits.maxCycles = job.budget;
+		limits.maxInstructions = job.instructions;
+		limits.timeoutNanos = job.timeoutMillis * 1000000;
+		limits.sliceCycles = COUNTER_SLICE;
+		limits.onSlice = [&counters](CPU& sliced){ counters.publish(sliced); };
+		uint64_t startInstructions = cpu.instructions;
+		RunResult result = cpu.run_limited(limits);
+		bool limited = result.reason == StopReason::CYCLE_BUDGET || result.reason == StopReason::INSTRUCTION_BUDGET
+					   || result.reason == StopReason::DEADLINE;
+		for(TranslationCache* cache : used)
+			if(cache->harvest(cpu))
+				cache->save();
+
+		// The client's job id is appended, only the fixed-size fields go through line
+		char line[160];
+		snprintf(line, sizeof(line), " cycles=%llu instructions=%llu pc=%04X",
+				 static_cast<unsigned long long>(result.cycles), static_cast<unsigned long long>(cpu.instructions - startInstructions), result.pc);
+		std::string reply = "RESULT " + job.id + " " + stopReasonName(result.reason) + line;
+		if(result.reason == StopReason::PROTECTION_FAULT){
+			snprintf(line, sizeof(line), " fault=%04X access=%c at=%04X", cpu.fault.address,
+					 cpu.fault.access == PERM_WRITE ? 'w' : cpu.fault.access == PERM_READ ? 'r' : 'x', cpu.fault.pc);
+			reply += line;
+		} 
+		reply += "\n";
+		if(job.registers || limited){
+			snprintf(line, sizeof(line), " A=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X SP=%04X FLAGS=%02X\n",
+					 cpu.reg_A, cpu.reg_B, cpu.reg_C, cpu.reg_D, cpu.reg_E, cpu.reg_H, cpu.reg_L, cpu.reg_SP, cpu.reg_FLAGS);
+			reply += "REGS " + job.id + line;
+		}
+		if(job.ports)
+			reply += "PORTS " + job.id + " " + encodeHex(cpu.ports, sizeof(cpu.ports)) + "\n";
+		for(const MemoryOutput& output : job.memory){
+			std::vector<uint8_t> bytes(output.length);
+			for(uint32_t i = 0; i < output.length; i++)
+				bytes[i] = cpu.peekByte(output.address + i);
+			reply += "MEM " + job.id + " " + Logger::hexString(output.address, 4) + " " + encodeHex(bytes.data(), bytes.size()) + "\n";
+		}
+		reply += "DONE " + job.id + "\n";
+		return reply;
+	}
+
+	static std::string encodeHex(const uint8_t* bytes, size_t length){
+		std::string text(length * 2, '0');
+		for(size_t i = 0; i < length; i++)
+			Logger::writeHex(&text[i * 2], bytes[i], 2);
+		return text;
+	}
+
+	static int hexDigit(char c){
+		if(c >= '0' && c <= '9') return c - '0';
+		if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+	static bool decodeHex(const std::string& hex, std::vector<uint8_t>& bytes){
+		if(hex.size() % 2 || hex.size() > 0x20000)
+			return false;
+		bytes.resize(hex.size() / 2);
+		for(size_t i = 0; i < bytes.size(); i++){
+			int high = hexDigit(hex[i * 2]), low = hexDigit(hex[i * 2 + 1]);
+			if(high < 0 || low < 0)
+				return false;
+			bytes[i] = static_cast<uint8_t>(high << 4 | low);
+		}
+		return true;
+	}
+};
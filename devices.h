@@ -0,0 +1,205 @@
+#pragma once
+
+#if __cplusplus < 202002L
+#error "devices.h needs C++20 coroutines (-std=c++20)"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <queue>
+#include <vector>
+#include "cpu.h"
+
+// Peripherals written as straight-line coroutines that wait for CPU time or port accesses:
+//
+//   Device timer(DeviceScheduler& bus){
+//       while(true){
+//           co_await bus.delay(20000);
+//           bus.cpu.interrupt(7);
+//       }
+//   }
+//   scheduler.add(timer(scheduler));
+//
+// Everything runs on the thread that calls DeviceScheduler::run(), a device only runs when
+// the scheduler resumes it, so there is no locking and no context switch.
+class Device {
+public:
+	struct promise_type {
+		Device get_return_object(){
+			return Device(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		// Started by DeviceScheduler::add(), kept after the end until the Device goes away
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception(){
+			std::terminate();
+		}
+	};
+
+	Device(Device&& other) noexcept : handle(other.handle) {
+		other.handle = nullptr;
+	}
+	Device(const Device&) = delete;
+	Device& operator=(const Device&) = delete;
+	~Device(){
+		if(handle)
+			handle.destroy();
+	}
+
+	bool done() const { return !handle || handle.done(); }
+
+private:
+	friend class DeviceScheduler;
+	explicit Device(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+	std::coroutine_handle<promise_type> handle;
+};
+
+// Runs a CPU and resumes its devices at the right T-state. Waits on time are resumed at the
+// first instruction boundary at or after their cycle, waits on ports right inside the IN or OUT
+// that completes them. Devices are resumed in the order they started waiting, so a run is as
+// deterministic as the program.
+//
+// The scheduler takes over cpu.onInput and cpu.onOutput.
+class DeviceScheduler {
+public:
+	CPU& cpu;
+
+	explicit DeviceScheduler(CPU& cpu) : cpu(cpu) {
+		cpu.onOutput = [this](uint8_t port, uint8_t value){
+			wake(outputWaiters[port], value);
+		};
+		// A device resumed by the read can still change the latch the IN returns
+		cpu.onInput = [this](uint8_t port){
+			wake(inputWaiters[port], this->cpu.ports[port]);
+			return this->cpu.ports[port];
+		};
+	}
+	DeviceScheduler(const DeviceScheduler&) = delete;
+	DeviceScheduler& operator=(const DeviceScheduler&) = delete;
+	~DeviceScheduler(){
+		cpu.onOutput = nullptr;
+		cpu.onInput = nullptr;
+	}
+
+	// Starts a device, it runs up to its first wait right away
+	void add(Device device){
+		devices.push_back(std::move(device));
+		devices.back().handle.resume();
+	}
+
+	// co_await delay(n): resume n T-states from now
+	auto delay(uint64_t nCycles){
+		return TimeAwaiter{*this, cpu.cycles + nCycles};
+	}
+	// co_await until(cycle): resume once cpu.cycles has reached cycle
+	auto until(uint64_t cycle){
+		return TimeAwaiter{*this, cycle};
+	}
+	// co_await output(port): resume at the next OUT to port, gives the byte written
+	auto output(uint8_t port){
+		return PortAwaiter(outputWaiters[port]);
+	}
+	// co_await input(port): resume at the next IN from port, before it reads cpu.ports[port]
+	auto input(uint8_t port){
+		return PortAwaiter(inputWaiters[port]);
+	}
+
+	// Runs the CPU for at least nCycles with its devices. A halted CPU idles to the next device
+	// wake-up, the run ends early when it is halted with no device left to wake it. Stops for
+	// breakpoints and watchpoints are passed on.
+	RunResult run(uint64_t nCycles){
+		RunResult result;
+		uint64_t start = cpu.cycles;
+		uint64_t end = start + nCycles;
+		while(true){
+			resumeDue();
+			if(cpu.cycles >= end){
+				result.reason = StopReason::CYCLE_BUDGET;
+				break;
+			}
+			// Port stops hand control back after every IN/OUT, a resumed device may have
+			// asked for a wake-up sooner than the slice would end
+			StopCondition condition;
+			condition.port = StopCondition::ANY_PORT;
+			condition.maxCycles = std::min(end, nextWake()) - cpu.cycles;
+			RunResult slice = cpu.run_until(condition);
+			if(slice.reason == StopReason::HALTED){
+				if(timers.empty()){
+					result = slice;
+					break;
+				}
+				cpu.cycles = std::max(cpu.cycles, std::min(end, nextWake()));
+			} else if(slice.reason != StopReason::CYCLE_BUDGET && slice.reason != StopReason::PORT_EVENT){
+				result = slice;
+				break;
+			}
+		}
+		result.cycles = cpu.cycles - start;
+		result.pc = cpu.reg_PC;
+		return result;
+	}
+
+private:
+	struct Timer {
+		uint64_t cycle;
+		uint64_t order;
+		std::coroutine_handle<> handle;
+		bool operator>(const Timer& other) const {
+			return cycle != other.cycle ? cycle > other.cycle : order > other.order;
+		}
+	};
+
+	struct TimeAwaiter {
+		DeviceScheduler& scheduler;
+		uint64_t cycle;
+		bool await_ready() const { return scheduler.cpu.cycles >= cycle; }
+		void await_suspend(std::coroutine_handle<> handle){
+			scheduler.timers.push({cycle, scheduler.timerOrder++, handle});
+		}
+		void await_resume() {}
+	};
+
+	struct PortAwaiter {
+		explicit PortAwaiter(std::vector<PortAwaiter*>& waiters) : waiters(waiters) {}
+		std::vector<PortAwaiter*>& waiters;
+		uint8_t value = 0;
+		std::coroutine_handle<> handle{};
+		bool await_ready() const { return false; }
+		void await_suspend(std::coroutine_handle<> waiting){
+			handle = waiting;
+			waiters.push_back(this);
+		}
+		uint8_t await_resume() const { return value; }
+	};
+
+	std::vector<Device> devices;
+	std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+	uint64_t timerOrder = 0;
+	std::vector<PortAwaiter*> outputWaiters[0x100];
+	std::vector<PortAwaiter*> inputWaiters[0x100];
+
+	uint64_t nextWake() const {
+		return timers.empty() ? UINT64_MAX : timers.top().cycle;
+	}
+
+	void resumeDue(){
+		while(!timers.empty() && timers.top().cycle <= cpu.cycles){
+			std::coroutine_handle<> handle = timers.top().handle;
+			timers.pop();
+			handle.resume();
+		}
+	}
+
+	// Waiters that wait again while being resumed go on a fresh list for the next access
+	void wake(std::vector<PortAwaiter*>& waiters, uint8_t value){
+		if(waiters.empty())
+			return;
+		std::vector<PortAwaiter*> resumed;
+		resumed.swap(waiters);
+		for(PortAwaiter* waiter : resumed){
+			waiter->value = value;
+			waiter->handle.resume();
+		}
+	}
+};
@@ -0,0 +1,517 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+
+// How an instruction hands over control, used by the code-flow analyzer
+enum FlowType {
+	FLOW_NONE,			// falls through to the next instruction
+	FLOW_JUMP,			// JMP a16
+	FLOW_COND_JUMP,		// Jcc a16, taken or falls through
+	FLOW_CALL,			// CALL a16, returns to the next instruction
+	FLOW_COND_CALL,		// Ccc a16
+	FLOW_RST,			// RST n, call to vector n * 8
+	FLOW_RET,			// RET
+	FLOW_COND_RET,		// Rcc, returns or falls through
+	FLOW_INDIRECT,		// PCHL, target only known at run time
+	FLOW_HALT,			// HLT
+	FLOW_INVALID		// --- Unused opcode, most likely data
+};
+
+struct OpcodeInfo {
+	const char* mnemonic;	// operand, if any, is appended after the mnemonic
+	uint8_t length;			// 1, 2 (d8) or 3 (d16 / a16) bytes
+	FlowType flow;
+};
+
+// One entry per opcode, same order and encoding as the OpCodes enum
+inline constexpr OpcodeInfo opcodeTable[256] = {
+	// 0x
+	{"NOP",       1, FLOW_NONE},		// 0x00
+	{"LXI B, ",   3, FLOW_NONE},		// 0x01
+	{"STAX B",    1, FLOW_NONE},		// 0x02
+	{"INX B",     1, FLOW_NONE},		// 0x03
+	{"INR B",     1, FLOW_NONE},		// 0x04
+	{"DCR B",     1, FLOW_NONE},		// 0x05
+	{"MVI B, ",   2, FLOW_NONE},		// 0x06
+	{"RLC",       1, FLOW_NONE},		// 0x07
+	{"???",       1, FLOW_INVALID},		// 0x08
+	{"DAD B",     1, FLOW_NONE},		// 0x09
+	{"LDAX B",    1, FLOW_NONE},		// 0x0A
+	{"DCX B",     1, FLOW_NONE},		// 0x0B
+	{"INR C",     1, FLOW_NONE},		// 0x0C
+	{"DCR C",     1, FLOW_NONE},		// 0x0D
+	{"MVI C, ",   2, FLOW_NONE},		// 0x0E
+	{"RRC",       1, FLOW_NONE},		// 0x0F
+
+	// 1x
+	{"???",       1, FLOW_INVALID},		// 0x10
+	{"LXI D, ",   3, FLOW_NONE},		// 0x11
+	{"STAX D",    1, FLOW_NONE},		// 0x12
+	{"INX D",     1, FLOW_NONE},		// 0x13
+	{"INR D",     1, FLOW_NONE},		// 0x14
+	{"DCR D",     1, FLOW_NONE},		// 0x15
+	{"MVI D, ",   2, FLOW_NONE},		// 0x16
+	{"RAL",       1, FLOW_NONE},		// 0x17
+	{"???",       1, FLOW_INVALID},		// 0x18
+	{"DAD D",     1, FLOW_NONE},		// 0x19
+	{"LDAX D",    1, FLOW_NONE},		// 0x1A
+	{"DCX D",     1, FLOW_NONE},		// 0x1B
+	{"INR E",     1, FLOW_NONE},		// 0x1C
+	{"DCR E",     1, FLOW_NONE},		// 0x1D
+	{"MVI E, ",   2, FLOW_NONE},		// 0x1E
+	{"RAR",       1, FLOW_NONE},		// 0x1F
+
+	// 2x
+	{"RIM",       1, FLOW_NONE},		// 0x20
+	{"LXI H, ",   3, FLOW_NONE},		// 0x21
+	{"SHLD ",     3, FLOW_NONE},		// 0x22
+	{"INX H",     1, FLOW_NONE},		// 0x23
+	{"INR H",     1, FLOW_NONE},		// 0x24
+	{"DCR H",     1, FLOW_NONE},		// 0x25
+	{"MVI H, ",   2, FLOW_NONE},		// 0x26
+	{"DAA",       1, FLOW_NONE},		// 0x27
+	{"???",       1, FLOW_INVALID},		// 0x28
+	{"DAD H",     1, FLOW_NONE},		// 0x29
+	{"LHLD ",     3, FLOW_NONE},		// 0x2A
+	{"DCX H",     1, FLOW_NONE},		// 0x2B
+	{"INR L",     1, FLOW_NONE},		// 0x2C
+	{"DCR L",     1, FLOW_NONE},		// 0x2D
+	{"MVI L, ",   2, FLOW_NONE},		// 0x2E
+	{"CMA",       1, FLOW_NONE},		// 0x2F
+
+	// 3x
+	{"SIM",       1, FLOW_NONE},		// 0x30
+	{"LXI SP, ",  3, FLOW_NONE},		// 0x31
+	{"STA ",      3, FLOW_NONE},		// 0x32
+	{"INX SP",    1, FLOW_NONE},		// 0x33
+	{"INR M",     1, FLOW_NONE},		// 0x34
+	{"DCR M",     1, FLOW_NONE},		// 0x35
+	{"MVI M, ",   2, FLOW_NONE},		// 0x36
+	{"STC",       1, FLOW_NONE},		// 0x37
+	{"???",       1, FLOW_INVALID},		// 0x38
+	{"DAD SP",    1, FLOW_NONE},		// 0x39
+	{"LDA ",      3, FLOW_NONE},		// 0x3A
+	{"DCX SP",    1, FLOW_NONE},		// 0x3B
+	{"INR A",     1, FLOW_NONE},		// 0x3C
+	{"DCR A",     1, FLOW_NONE},		// 0x3D
+	{"MVI A, ",   2, FLOW_NONE},		// 0x3E
+	{"CMC",       1, FLOW_NONE},		// 0x3F
+
+	// 4x
+	{"MOV B,B",   1, FLOW_NONE},		// 0x40
+	{"MOV B,C",   1, FLOW_NONE},		// 0x41
+	{"MOV B,D",   1, FLOW_NONE},		// 0x42
+	{"MOV B,E",   1, FLOW_NONE},		// 0x43
+	{"MOV B,H",   1, FLOW_NONE},		// 0x44
+	{"MOV B,L",   1, FLOW_NONE},		// 0x45
+	{"MOV B,M",   1, FLOW_NONE},		// 0x46
+	{"MOV B,A",   1, FLOW_NONE},		// 0x47
+	{"MOV C,B",   1, FLOW_NONE},		// 0x48
+	{"MOV C,C",   1, FLOW_NONE},		// 0x49
+	{"MOV C,D",   1, FLOW_NONE},		// 0x4A
+	{"MOV C,E",   1, FLOW_NONE},		// 0x4B
+	{"MOV C,H",   1, FLOW_NONE},		// 0x4C
+	{"MOV C,L",   1, FLOW_NONE},		// 0x4D
+	{"MOV C,M",   1, FLOW_NONE},		// 0x4E
+	{"MOV C,A",   1, FLOW_NONE},		// 0x4F
+
+	// 5x
+	{"MOV D,B",   1, FLOW_NONE},		// 0x50
+	{"MOV D,C",   1, FLOW_NONE},		// 0x51
+	{"MOV D,D",   1, FLOW_NONE},		// 0x52
+	{"MOV D,E",   1, FLOW_NONE},		// 0x53
+	{"MOV D,H",   1, FLOW_NONE},		// 0x54
+	{"MOV D,L",   1, FLOW_NONE},		// 0x55
+	{"MOV D,M",   1, FLOW_NONE},		// 0x56
+	{"MOV D,A",   1, FLOW_NONE},		// 0x57
+	{"MOV E,B",   1, FLOW_NONE},		// 0x58
+	{"MOV E,C",   1, FLOW_NONE},		// 0x59
+	{"MOV E,D",   1, FLOW_NONE},		// 0x5A
+	{"MOV E,E",   1, FLOW_NONE},		// 0x5B
+	{"MOV E,H",   1, FLOW_NONE},		// 0x5C
+	{"MOV E,L",   1, FLOW_NONE},		// 0x5D
+	{"MOV E,M",   1, FLOW_NONE},		// 0x5E
+	{"MOV E,A",   1, FLOW_NONE},		// 0x5F
+
+	// 6x
+	{"MOV H,B",   1, FLOW_NONE},		// 0x60
+	{"MOV H,C",   1, FLOW_NONE},		// 0x61
+	{"MOV H,D",   1, FLOW_NONE},		// 0x62
+	{"MOV H,E",   1, FLOW_NONE},		// 0x63
+	{"MOV H,H",   1, FLOW_NONE},		// 0x64
+	{"MOV H,L",   1, FLOW_NONE},		// 0x65
+	{"MOV H,M",   1, FLOW_NONE},		// 0x66
+	{"MOV H,A",   1, FLOW_NONE},		// 0x67
+	{"MOV L,B",   1, FLOW_NONE},		// 0x68
+	{"MOV L,C",   1, FLOW_NONE},		// 0x69
+	{"MOV L,D",   1, FLOW_NONE},		// 0x6A
+	{"MOV L,E",   1, FLOW_NONE},		// 0x6B
+	{"MOV L,H",   1, FLOW_NONE},		// 0x6C
+	{"MOV L,L",   1, FLOW_NONE},		// 0x6D
+	{"MOV L,M",   1, FLOW_NONE},		// 0x6E
+	{"MOV L,A",   1, FLOW_NONE},		// 0x6F
+
+	// 7x
+	{"MOV M,B",   1, FLOW_NONE},		// 0x70
+	{"MOV M,C",   1, FLOW_NONE},		// 0x71
+	{"MOV M,D",   1, FLOW_NONE},		// 0x72
+	{"MOV M,E",   1, FLOW_NONE},		// 0x73
+	{"MOV M,H",   1, FLOW_NONE},		// 0x74
+	{"MOV M,L",   1, FLOW_NONE},		// 0x75
+	{"HLT",       1, FLOW_HALT},		// 0x76
+	{"MOV M,A",   1, FLOW_NONE},		// 0x77
+	{"MOV A,B",   1, FLOW_NONE},		// 0x78
+	{"MOV A,C",   1, FLOW_NONE},		// 0x79
+	{"MOV A,D",   1, FLOW_NONE},		// 0x7A
+	{"MOV A,E",   1, FLOW_NONE},		// 0x7B
+	{"MOV A,H",   1, FLOW_NONE},		// 0x7C
+	{"MOV A,L",   1, FLOW_NONE},		// 0x7D
+	{"MOV A,M",   1, FLOW_NONE},		// 0x7E
+	{"MOV A,A",   1, FLOW_NONE},		// 0x7F
+
+	// 8x
+	{"ADD B",     1, FLOW_NONE},		// 0x80
+	{"ADD C",     1, FLOW_NONE},		// 0x81
+	{"ADD D",     1, FLOW_NONE},		// 0x82
+	{"ADD E",     1, FLOW_NONE},		// 0x83
+	{"ADD H",     1, FLOW_NONE},		// 0x84
+	{"ADD L",     1, FLOW_NONE},		// 0x85
+	{"ADD M",     1, FLOW_NONE},		// 0x86
+	{"ADD A",     1, FLOW_NONE},		// 0x87
+	{"ADC B",     1, FLOW_NONE},		// 0x88
+	{"ADC C",     1, FLOW_NONE},		// 0x89
+	{"ADC D",     1, FLOW_NONE},		// 0x8A
+	{"ADC E",     1, FLOW_NONE},		// 0x8B
+	{"ADC H",     1, FLOW_NONE},		// 0x8C
+	{"ADC L",     1, FLOW_NONE},		// 0x8D
+	{"ADC M",     1, FLOW_NONE},		// 0x8E
+	{"ADC A",     1, FLOW_NONE},		// 0x8F
+
+	// 9x
+	{"SUB B",     1, FLOW_NONE},		// 0x90
+	{"SUB C",     1, FLOW_NONE},		// 0x91
+	{"SUB D",     1, FLOW_NONE},		// 0x92
+	{"SUB E",     1, FLOW_NONE},		// 0x93
+	{"SUB H",     1, FLOW_NONE},		// 0x94
+	{"SUB L",     1, FLOW_NONE},		// 0x95
+	{"SUB M",     1, FLOW_NONE},		// 0x96
+	{"SUB A",     1, FLOW_NONE},		// 0x97
+	{"SBB B",     1, FLOW_NONE},		// 0x98
+	{"SBB C",     1, FLOW_NONE},		// 0x99
+	{"SBB D",     1, FLOW_NONE},		// 0x9A
+	{"SBB E",     1, FLOW_NONE},		// 0x9B
+	{"SBB H",     1, FLOW_NONE},		// 0x9C
+	{"SBB L",     1, FLOW_NONE},		// 0x9D
+	{"SBB M",     1, FLOW_NONE},		// 0x9E
+	{"SBB A",     1, FLOW_NONE},		// 0x9F
+
+	// Ax
+	{"ANA B",     1, FLOW_NONE},		// 0xA0
+	{"ANA C",     1, FLOW_NONE},		// 0xA1
+	{"ANA D",     1, FLOW_NONE},		// 0xA2
+	{"ANA E",     1, FLOW_NONE},		// 0xA3
+	{"ANA H",     1, FLOW_NONE},		// 0xA4
+	{"ANA L",     1, FLOW_NONE},		// 0xA5
+	{"ANA M",     1, FLOW_NONE},		// 0xA6
+	{"ANA A",     1, FLOW_NONE},		// 0xA7
+	{"XRA B",     1, FLOW_NONE},		// 0xA8
+	{"XRA C",     1, FLOW_NONE},		// 0xA9
+	{"XRA D",     1, FLOW_NONE},		// 0xAA
+	{"XRA E",     1, FLOW_NONE},		// 0xAB
+	{"XRA H",     1, FLOW_NONE},		// 0xAC
+	{"XRA L",     1, FLOW_NONE},		// 0xAD
+	{"XRA M",     1, FLOW_NONE},		// 0xAE
+	{"XRA A",     1, FLOW_NONE},		// 0xAF
+
+	// Bx
+	{"ORA B",     1, FLOW_NONE},		// 0xB0
+	{"ORA C",     1, FLOW_NONE},		// 0xB1
+	{"ORA D",     1, FLOW_NONE},		// 0xB2
+	{"ORA E",     1, FLOW_NONE},		// 0xB3
+	{"ORA H",     1, FLOW_NONE},		// 0xB4
+	{"ORA L",     1, FLOW_NONE},		// 0xB5
+	{"ORA M",     1, FLOW_NONE},		// 0xB6
+	{"ORA A",     1, FLOW_NONE},		// 0xB7
+	{"CMP B",     1, FLOW_NONE},		// 0xB8
+	{"CMP C",     1, FLOW_NONE},		// 0xB9
+	{"CMP D",     1, FLOW_NONE},		// 0xBA
+	{"CMP E",     1, FLOW_NONE},		// 0xBB
+	{"CMP H",     1, FLOW_NONE},		// 0xBC
+	{"CMP L",     1, FLOW_NONE},		// 0xBD
+	{"CMP M",     1, FLOW_NONE},		// 0xBE
+	{"CMP A",     1, FLOW_NONE},		// 0xBF
+
+	// Cx
+	{"RNZ",       1, FLOW_COND_RET},		// 0xC0
+	{"POP B",     1, FLOW_NONE},		// 0xC1
+	{"JNZ ",      3, FLOW_COND_JUMP},		// 0xC2
+	{"JMP ",      3, FLOW_JUMP},		// 0xC3
+	{"CNZ ",      3, FLOW_COND_CALL},		// 0xC4
+	{"PUSH B",    1, FLOW_NONE},		// 0xC5
+	{"ADI ",      2, FLOW_NONE},		// 0xC6
+	{"RST 0",     1, FLOW_RST},		// 0xC7
+	{"RZ",        1, FLOW_COND_RET},		// 0xC8
+	{"RET",       1, FLOW_RET},		// 0xC9
+	{"JZ ",       3, FLOW_COND_JUMP},		// 0xCA
+	{"???",       1, FLOW_INVALID},		// 0xCB
+	{"CZ ",       3, FLOW_COND_CALL},		// 0xCC
+	{"CALL ",     3, FLOW_CALL},		// 0xCD
+	{"ACI ",      2, FLOW_NONE},		// 0xCE
+	{"RST 1",     1, FLOW_RST},		// 0xCF
+
+	// Dx
+	{"RNC",       1, FLOW_COND_RET},		// 0xD0
+	{"POP D",     1, FLOW_NONE},		// 0xD1
+	{"JNC ",      3, FLOW_COND_JUMP},		// 0xD2
+	{"OUT ",      2, FLOW_NONE},		// 0xD3
+	{"CNC ",      3, FLOW_COND_CALL},		// 0xD4
+	{"PUSH D",    1, FLOW_NONE},		// 0xD5
+	{"SUI ",      2, FLOW_NONE},		// 0xD6
+	{"RST 2",     1, FLOW_RST},		// 0xD7
+	{"RC",        1, FLOW_COND_RET},		// 0xD8
+	{"???",       1, FLOW_INVALID},		// 0xD9
+	{"JC ",       3, FLOW_COND_JUMP},		// 0xDA
+	{"IN ",       2, FLOW_NONE},		// 0xDB
+	{"CC ",       3, FLOW_COND_CALL},		// 0xDC
+	{"???",       1, FLOW_INVALID},		// 0xDD
+	{"SBI ",      2, FLOW_NONE},		// 0xDE
+	{"RST 3",     1, FLOW_RST},		// 0xDF
+
+	// Ex
+	{"RPO",       1, FLOW_COND_RET},		// 0xE0
+	{"POP H",     1, FLOW_NONE},		// 0xE1
+	{"JPO ",      3, FLOW_COND_JUMP},		// 0xE2
+	{"XTHL",      1, FLOW_NONE},		// 0xE3
+	{"CPO ",      3, FLOW_COND_CALL},		// 0xE4
+	{"PUSH H",    1, FLOW_NONE},		// 0xE5
+	{"ANI ",      2, FLOW_NONE},		// 0xE6
+	{"RST 4",     1, FLOW_RST},		// 0xE7
+	{"RPE",       1, FLOW_COND_RET},		// 0xE8
+	{"PCHL",      1, FLOW_INDIRECT},		// 0xE9
+	{"JPE ",      3, FLOW_COND_JUMP},		// 0xEA
+	{"XCHG",      1, FLOW_NONE},		// 0xEB
+	{"CPE ",      3, FLOW_COND_CALL},		// 0xEC
+	{"???",       1, FLOW_INVALID},		// 0xED
+	{"XRI ",      2, FLOW_NONE},		// 0xEE
+	{"RST 5",     1, FLOW_RST},		// 0xEF
+
+	// Fx
+	{"RP",        1, FLOW_COND_RET},		// 0xF0
+	{"POP PSW",   1, FLOW_NONE},		// 0xF1
+	{"JP ",       3, FLOW_COND_JUMP},		// 0xF2
+	{"DI",        1, FLOW_NONE},		// 0xF3
+	{"CP ",       3, FLOW_COND_CALL},		// 0xF4
+	{"PUSH PSW",  1, FLOW_NONE},		// 0xF5
+	{"ORI ",      2, FLOW_NONE},		// 0xF6
+	{"RST 6",     1, FLOW_RST},		// 0xF7
+	{"RM",        1, FLOW_COND_RET},		// 0xF8
+	{"SPHL",      1, FLOW_NONE},		// 0xF9
+	{"JM ",       3, FLOW_COND_JUMP},		// 0xFA
+	{"EI",        1, FLOW_NONE},		// 0xFB
+	{"CM ",       3, FLOW_COND_CALL},		// 0xFC
+	{"???",       1, FLOW_INVALID},		// 0xFD
+	{"CPI ",      2, FLOW_NONE},		// 0xFE
+	{"RST 7",     1, FLOW_RST},		// 0xFF
+};
+
+static_assert(opcodeTable[LXI_B_D16].length == 3 && opcodeTable[MVI_M_D8].length == 2, "opcodeTable out of sync with OpCodes");
+static_assert(opcodeTable[JNZ_A16].flow == FLOW_COND_JUMP && opcodeTable[CALL_A16].flow == FLOW_CALL, "opcodeTable out of sync with OpCodes");
+static_assert(opcodeTable[RST_7].flow == FLOW_RST && opcodeTable[HLT].flow == FLOW_HALT, "opcodeTable out of sync with OpCodes");
+
+inline uint16_t operandAt(const uint8_t* memory, size_t memorySize, uint16_t address){
+	uint8_t low = static_cast<size_t>(address + 1) < memorySize ? memory[address + 1] : 0;
+	uint8_t high = static_cast<size_t>(address + 2) < memorySize ? memory[address + 2] : 0;
+	return (static_cast<uint16_t>(high) << 8) | low;
+}
+
+// Target of a JMP/Jcc/CALL/Ccc/RST, only meaningful for those flow types
+inline uint16_t branchTarget(const uint8_t* memory, size_t memorySize, uint16_t address){
+	uint8_t opcode = memory[address];
+	if(opcodeTable[opcode].flow == FLOW_RST)
+		return opcode & 0x38;
+	return operandAt(memory, memorySize, address);
+}
+
+// Single instruction as text, e.g. "MVI B, 0x04" or "JNZ 0x000A"
+inline std::string disassemble(const uint8_t* memory, size_t memorySize, uint16_t address){
+	const OpcodeInfo& info = opcodeTable[memory[address]];
+	char operand[8] = "";
+	if(info.length == 2)
+		snprintf(operand, sizeof(operand), "0x%02X", static_cast<size_t>(address + 1) < memorySize ? memory[address + 1] : 0);
+	else if(info.length == 3)
+		snprintf(operand, sizeof(operand), "0x%04X", operandAt(memory, memorySize, address));
+	return std::string(info.mnemonic) + operand;
+}
+
+struct BasicBlock {
+	uint16_t start;
+	uint32_t end;				// first byte after the block, 0x10000 at the top of memory
+	int instructionCount;
+	std::vector<uint16_t> successors;	// statically known, calls excluded
+};
+
+// Result of the static walk over an image
+struct CodeMap {
+	uint16_t imageStart = 0;
+	uint32_t imageEnd = 0;							// first byte after the image, up to 0x10000
+	std::map<uint16_t, BasicBlock> blocks;			// by start address
+	std::set<uint16_t> functions;					// entry points and call / RST targets
+	std::vector<std::pair<uint16_t, uint32_t>> dataRegions;	// [start, end) never reached as code
+	std::vector<uint16_t> indirectJumps;			// PCHL sites, their targets are unknown
+	std::vector<uint8_t> code = std::vector<uint8_t>(0x10000, 0);	// 1 = byte belongs to a decoded instruction
+};
+
+// Entry point plus the eight RST vectors
+inline std::vector<uint16_t> defaultEntryPoints(uint16_t entry){
+	std::vector<uint16_t> entries = {entry};
+	for(uint16_t vector = 0x00; vector <= 0x38; vector += 0x08)
+		if(vector != entry)
+			entries.push_back(vector);
+	return entries;
+}
+
+// Walks every instruction reachable from the entry points inside [imageStart, imageEnd),
+// then cuts the reached code into basic blocks. Calls and RST end a block, so each block
+// is a straight run that a block cache can execute with a single dispatch.
+inline CodeMap analyzeCode(const uint8_t* memory, size_t memorySize, uint16_t imageStart, uint32_t imageEnd, const std::vector<uint16_t>& entries){
+	CodeMap map;
+	map.imageStart = imageStart;
+	map.imageEnd = imageEnd;
+	auto inImage = [&](uint32_t address){
+		return address >= imageStart && address < imageEnd && address < memorySize;
+	};
+
+	std::vector<uint8_t> instructionStart(0x10000, 0);
+	std::set<uint16_t> leaders;
+	std::vector<uint16_t> work;
+	for(uint16_t entry : entries){
+		if(inImage(entry)){
+			leaders.insert(entry);
+			map.functions.insert(entry);
+			work.push_back(entry);
+		} 
+	} 
+
+	// Pass 1 : reachability, collects instruction starts and block leaders
+	while(!work.empty()){
+		uint32_t address = work.back();
+		work.pop_back();
+
+		while(inImage(address) && !instructionStart[address]){
+			const OpcodeInfo& info = opcodeTable[memory[address]];
+			if(info.flow == FLOW_INVALID)
+				break;
+			instructionStart[address] = 1;
+			for(int i = 0; i < info.length && address + i < 0x10000; i++)
+				map.code[address + i] = 1;
+
+			uint32_t next = address + info.length;
+			bool fallsThrough = true;
+			switch(info.flow){
+				case FLOW_JUMP:
+				case FLOW_COND_JUMP:
+				case FLOW_CALL:
+				case FLOW_COND_CALL:
+				case FLOW_RST: {
+					uint16_t target = branchTarget(memory, memorySize, address);
+					if(inImage(target)){
+						leaders.insert(target);
+						work.push_back(target);
+						if(info.flow == FLOW_CALL || info.flow == FLOW_COND_CALL || info.flow == FLOW_RST)
+							map.functions.insert(target);
+					} 
+					fallsThrough = info.flow != FLOW_JUMP;
+					break;
+				} 
+				case FLOW_INDIRECT:
+					map.indirectJumps.push_back(address);
+					fallsThrough = false;
+					break;
+				case FLOW_RET:
+				case FLOW_HALT:
+					fallsThrough = false;
+					break;
+				default:
+					break;
+			} 
+
+			if(info.flow != FLOW_NONE && fallsThrough && inImage(next))
+				leaders.insert(next);
+			if(!fallsThrough)
+				break;
+			address = next;
+		} 
+	} 
+
+	// Pass 2 : blocks run from a leader to the next control transfer or leader
+	for(uint16_t leader : leaders){
+		if(!instructionStart[leader])
+			continue;
+		BasicBlock block = {leader, leader, 0, {}};
+		uint32_t address = leader;
+		while(true){
+			const OpcodeInfo& info = opcodeTable[memory[address]];
+			block.instructionCount++;
+			uint32_t next = address + info.length;
+			block.end = next;
+
+			if(info.flow == FLOW_JUMP || info.flow == FLOW_COND_JUMP)
+				block.successors.push_back(branchTarget(memory, memorySize, address));
+			bool fallsThrough = info.flow != FLOW_JUMP && info.flow != FLOW_RET && info.flow != FLOW_INDIRECT && info.flow != FLOW_HALT;
+			if(fallsThrough && inImage(next) && instructionStart[next] && (info.flow != FLOW_NONE || leaders.count(next)))
+				block.successors.push_back(next);
+
+			if(info.flow != FLOW_NONE || !inImage(next) || !instructionStart[next] || leaders.count(next))
+				break;
+			address = next;
+		} 
+		map.blocks[leader] = block;
+	} 
+
+	// Whatever is left in the image was never reached as code
+	for(uint32_t address = imageStart; address < imageEnd && address < memorySize; address++){
+		if(map.code[address])
+			continue;
+		uint32_t start = address;
+		while(address < imageEnd && address < memorySize && !map.code[address])
+			address++;
+		map.dataRegions.push_back({static_cast<uint16_t>(start), address});
+	} 
+	return map;
+}
+
+// Annotated listing : functions, block starts, instructions and data regions
+inline void printCodeMap(const CodeMap& map, const uint8_t* memory, size_t memorySize){
+	Logger& log = logger();
+	auto lock = log.lock();
+	size_t data = 0;
+	for(uint32_t address = map.imageStart; address < map.imageEnd && address < memorySize; ){
+		if(data < map.dataRegions.size() && map.dataRegions[data].first == address){
+			uint32_t end = map.dataRegions[data].second;
+			log.hex(address, 4).put("  DB  ").dec(end - address).put(" byte(s) of data").endLine();
+			address = end;
+			data++;
+			continue;
+		} 
+		if(map.functions.count(address)){
+			log.endLine();
+			log.hex(address, 4).put("  ; ---- function").endLine();
+		} 
+		auto block = map.blocks.find(address);
+		if(block != map.blocks.end()){
+			log.hex(address, 4).put("  ; block, ").dec(block->second.instructionCount).put(" instruction(s) ->");
+			for(uint16_t successor : block->second.successors)
+				log.put(' ').hex(successor, 4);
+			log.endLine();
+		} 
+		log.hex(address, 4).put("      ").put(disassemble(memory, memorySize, address)).endLine();
+		address += opcodeTable[memory[address]].length;
+	} 
+}
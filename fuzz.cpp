@@ -0,0 +1,68 @@
+// libFuzzer entry point: every input is loaded at 0x0000 through the program loader and run
+// for a fixed T-state budget on one reused core.
+//
+//   clang++ -g -O1 -fsanitize=fuzzer,address,undefined fuzz.cpp -o fuzz8080
+//   ./fuzz8080 corpus/
+//
+// Without libFuzzer, -DFUZZ_STANDALONE builds a driver that runs each file given on the
+// command line (or random inputs when there are none) under the same checks.
+
+#include <cstdlib>
+#include <cstdio>
+#include "cpu.h"
+
+static constexpr uint64_t FUZZ_CYCLE_BUDGET = 4096;
+static constexpr int MAX_INSTRUCTION_CYCLES = 18;		// XTHL
+
+#define FUZZ_CHECK(condition) do { if(!(condition)) { fprintf(stderr, "invariant failed: %s\n", #condition); abort(); } } while(0)
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size){
+	static CPU* cpu = [](){
+		logger().setLevel(LOG_ERROR);
+		CPU* fresh = new CPU();
+		fresh->setBaseline();
+		return fresh;
+	}();
+	cpu->resetToBaseline();
+
+	size_t loaded = loadProgramFromBytes(data, size, cpu->memory, sizeof(cpu->memory), 0x0000);
+	cpu->markDirty(0x0000, loaded);
+	FUZZ_CHECK(loaded == std::min(size, sizeof(cpu->memory)));
+
+	RunResult result = cpu->run_for(FUZZ_CYCLE_BUDGET);
+
+	// The budget is checked between instructions, so it is overshot by at most one
+	FUZZ_CHECK(result.reason == StopReason::HALTED || result.reason == StopReason::CYCLE_BUDGET);
+	FUZZ_CHECK(result.cycles == cpu->cycles);
+	FUZZ_CHECK(result.cycles < FUZZ_CYCLE_BUDGET + MAX_INSTRUCTION_CYCLES);
+	FUZZ_CHECK(result.reason != StopReason::CYCLE_BUDGET || result.cycles >= FUZZ_CYCLE_BUDGET);
+	FUZZ_CHECK(result.pc == cpu->reg_PC);
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+int main(int argc, char* argv[]){
+	if(argc > 1){
+		for(int i = 1; i < argc; i++){
+			std::ifstream file(argv[i], std::ios::binary);
+			std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			LLVMFuzzerTestOneInput(input.data(), input.size());
+		}
+		return 0;
+	}
+	std::mt19937 random(0);
+	std::vector<uint8_t> input;
+	for(int run = 0; run < 100000; run++){
+		input.resize(random() % 512);
+		for(uint8_t& byte : input)
+			byte = static_cast<uint8_t>(random());
+		LLVMFuzzerTestOneInput(input.data(), input.size());
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,478 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "cpu.h"
+
+// GDB remote serial protocol stub on a local TCP or Unix socket.
+// The socket is served by its own thread which only queues packets, the CPU itself is
+// only touched from the host thread in sliceBoundary(), between two run_for() slices.
+//
+// Registers follow the gdb z80 layout ("set architecture z80"), 16 bits little-endian each :
+// 0 = PSW (A, FLAGS), 1 = BC, 2 = DE, 3 = HL, 4 = SP, 5 = PC
+class GdbStub {
+public:
+	static constexpr int REGISTER_COUNT = 6;
+
+	explicit GdbStub(CPU& cpu) : cpu(cpu) {}
+	~GdbStub(){
+		stop();
+	}
+
+	bool listenTcp(uint16_t port){
+		int fd = socket(AF_INET, SOCK_STREAM, 0);
+		if(fd < 0)
+			return false;
+		int yes = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, 1) < 0){
+			close(fd);
+			return false;
+		}
+		return start(fd);
+	}
+
+	bool listenUnix(const std::string& path){
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(fd < 0)
+			return false;
+
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+		unlink(path.c_str());
+		if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, 1) < 0){
+			close(fd);
+			return false;
+		}
+		unixPath = path;
+		return start(fd);
+	}
+
+	void stop(){
+		quit = true;
+		if(listenFd >= 0)
+			shutdown(listenFd, SHUT_RDWR);
+		if(clientFd >= 0)
+			shutdown(clientFd, SHUT_RDWR);
+		if(server.joinable())
+			server.join();
+		if(listenFd >= 0)
+			close(listenFd);
+		listenFd = -1;
+		if(!unixPath.empty())
+			unlink(unixPath.c_str());
+		unixPath.clear();
+	}
+
+	bool isConnected(){
+		return connected;
+	}
+
+	void waitForAttach(){
+		std::unique_lock<std::mutex> lock(packetMutex);
+		packetReady.wait(lock, [&]{ return connected || quit; });
+	}
+
+	// Called by the host between two slices. Returns immediately while the target runs,
+	// otherwise reports the stop to gdb and serves its commands until it resumes.
+	void sliceBoundary(const RunResult& last){
+		if(!connected)
+			return;
+
+		if(attachPending.exchange(false)){
+			// gdb asks for the stop reason itself with '?'
+		} else if(last.reason == StopReason::HALTED){
+			sendPacket("W00");
+			return;
+		} else if(last.reason == StopReason::BREAKPOINT){
+			sendPacket("S05");
+		} else if(last.reason == StopReason::WATCHPOINT){
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "T05%s:%04x;", last.access == WATCH_WRITE ? "watch" : "rwatch", last.address);
+			sendPacket(buffer);
+		} else if(last.reason == StopReason::PROTECTION_FAULT){
+			sendPacket("S0b");		// SIGSEGV
+		} else if(interruptRequested.exchange(false)){
+			sendPacket("S02");
+		} else {
+			return;
+		}
+		serve();
+	}
+
+	// Runs the CPU in slices under debugger control until HLT or until gdb kills it
+	void run(uint64_t sliceCycles = 10000){
+		RunResult result;
+		while(true){
+			sliceBoundary(result);
+			// halted by a step or a kill while stopped, gdb already knows
+			if(killed || (cpu.HALT && !cpu.faulted))
+				return;
+			result = cpu.run_for(sliceCycles);
+			if(result.reason == StopReason::HALTED){
+				sliceBoundary(result);
+				return;
+			}
+			// A faulted target cannot go on: gdb can look at its state and every continue
+			// reports the fault again, until it kills or detaches
+			if(result.reason == StopReason::PROTECTION_FAULT && !connected)
+				return;
+		}
+	}
+
+private:
+	CPU& cpu;
+	std::thread server;
+	int listenFd = -1;
+	std::atomic<int> clientFd{-1};
+	std::string unixPath;
+
+	std::atomic<bool> quit{false};
+	std::atomic<bool> connected{false};
+	std::atomic<bool> attachPending{false};
+	std::atomic<bool> interruptRequested{false};
+	bool killed = false;
+
+	std::mutex packetMutex;
+	std::condition_variable packetReady;
+	std::deque<std::string> packets;
+	std::mutex sendMutex;
+
+	bool start(int fd){
+		listenFd = fd;
+		quit = false;
+		server = std::thread([this]{ serverLoop(); });
+		return true;
+	}
+
+	void serverLoop(){
+		while(!quit){
+			int fd = accept(listenFd, nullptr, nullptr);
+			if(fd < 0)
+				return;
+			clientFd = fd;
+			{
+				std::lock_guard<std::mutex> lock(packetMutex);
+				packets.clear();
+				attachPending = true;
+				connected = true;
+			}
+			packetReady.notify_all();
+
+			readLoop(fd);
+
+			{
+				std::lock_guard<std::mutex> lock(packetMutex);
+				connected = false;
+			}
+			packetReady.notify_all();
+			clientFd = -1;
+			close(fd);
+		}
+	}
+
+	// Splits the byte stream into packets, acks them and queues them for the CPU thread.
+	// A bare 0x03 is gdb's interrupt request, honored at the next slice boundary.
+	void readLoop(int fd){
+		enum { IDLE, BODY, CHECKSUM_HIGH, CHECKSUM_LOW } state = IDLE;
+		std::string packet;
+		uint8_t checksum = 0;
+		char buffer[1024];
+
+		while(true){
+			ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+			if(count <= 0)
+				return;
+			for(ssize_t i = 0; i < count; i++){
+				char c = buffer[i];
+				switch(state){
+					case IDLE:
+						if(c == '$'){
+							packet.clear();
+							state = BODY;
+						} else if(c == 0x03){
+							interruptRequested = true;
+						}
+						break;
+					case BODY:
+						if(c == '#')
+							state = CHECKSUM_HIGH;
+						else
+							packet += c;
+						break;
+					case CHECKSUM_HIGH:
+						checksum = hexValue(c) << 4;
+						state = CHECKSUM_LOW;
+						break;
+					case CHECKSUM_LOW:
+						checksum |= hexValue(c);
+						if(checksum == packetChecksum(packet)){
+							sendRaw("+");
+							{
+								std::lock_guard<std::mutex> lock(packetMutex);
+								packets.push_back(packet);
+							}
+							packetReady.notify_all();
+						} else {
+							sendRaw("-");
+						}
+						state = IDLE;
+						break;
+				}
+			}
+		}
+	}
+
+	// Handles commands while the target is stopped, returns when gdb resumes or leaves
+	void serve(){
+		while(true){
+			std::string packet;
+			{
+				std::unique_lock<std::mutex> lock(packetMutex);
+				packetReady.wait(lock, [&]{ return !packets.empty() || !connected; });
+				if(packets.empty())
+					return;
+				packet = packets.front();
+				packets.pop_front();
+			}
+			if(handlePacket(packet))
+				return;
+		}
+	}
+
+	// Returns true when the command resumes the target
+	bool handlePacket(const std::string& packet){
+		if(packet.empty()){
+			sendPacket("");
+			return false;
+		}
+
+		const char* args = packet.c_str() + 1;
+		switch(packet[0]){
+			case '?':
+				sendPacket(cpu.faulted ? "S0b" : "S05");
+				return false;
+
+			case 'g': {
+				std::string reply;
+				for(int i = 0; i < REGISTER_COUNT; i++)
+					reply += hex16(readRegister(i));
+				sendPacket(reply);
+				return false;
+			}
+			case 'G':
+				for(int i = 0; i < REGISTER_COUNT && strlen(args) >= (i + 1) * 4u; i++)
+					writeRegister(i, parseHex16(args + i * 4));
+				sendPacket("OK");
+				return false;
+			case 'p': {
+				unsigned n = strtoul(args, nullptr, 16);
+				sendPacket(n < REGISTER_COUNT ? hex16(readRegister(n)) : "E01");
+				return false;
+			}
+			case 'P': {
+				char* value = nullptr;
+				unsigned n = strtoul(args, &value, 16);
+				if(n >= REGISTER_COUNT || *value != '='){
+					sendPacket("E01");
+					return false;
+				}
+				writeRegister(n, parseHex16(value + 1));
+				sendPacket("OK");
+				return false;
+			}
+
+			case 'm': {
+				char* length = nullptr;
+				unsigned address = strtoul(args, &length, 16);
+				if(*length != ','){
+					sendPacket("E01");
+					return false;
+				}
+				unsigned count = strtoul(length + 1, nullptr, 16);
+				std::string reply;
+				for(unsigned i = 0; i < count && address + i < sizeof(cpu.memory); i++)
+					reply += hex8(cpu.peekByte(address + i));
+				sendPacket(reply.empty() && count ? "E01" : reply);
+				return false;
+			}
+			case 'M': {
+				char* length = nullptr;
+				unsigned address = strtoul(args, &length, 16);
+				if(*length != ','){
+					sendPacket("E01");
+					return false;
+				}
+				char* data = nullptr;
+				unsigned count = strtoul(length + 1, &data, 16);
+				if(*data != ':' || strlen(data + 1) < count * 2 || address + count > sizeof(cpu.memory)){
+					sendPacket("E01");
+					return false;
+				}
+				for(unsigned i = 0; i < count; i++)
+					cpu.pokeByte(address + i, (hexValue(data[1 + i * 2]) << 4) | hexValue(data[2 + i * 2]));
+				sendPacket("OK");
+				return false;
+			}
+
+			case 'Z':
+			case 'z': {
+				char* rest = nullptr;
+				unsigned type = strtoul(args, &rest, 16);
+				if(*rest != ','){
+					sendPacket("E01");
+					return false;
+				}
+				unsigned long address = strtoul(rest + 1, &rest, 16);
+				if(*rest != ','){
+					sendPacket("E01");
+					return false;
+				}
+				unsigned long kind = strtoul(rest + 1, nullptr, 16);
+				bool insert = packet[0] == 'Z';
+				// Nothing above the 16-bit address space, also not the end of a watched range
+				if(address > 0xFFFF || (type >= 2 && type <= 4 && address + (kind ? kind : 1) - 1 > 0xFFFF)){
+					sendPacket("E01");
+					return false;
+				}
+				if(type <= 1){
+					if(insert)
+						cpu.addBreakpoint(address);
+					else
+						cpu.removeBreakpoint(address);
+				} else if(type <= 4){
+					uint16_t end = address + (kind ? kind : 1) - 1;
+					uint8_t access = type == 2 ? WATCH_WRITE : type == 3 ? WATCH_READ : (WATCH_READ | WATCH_WRITE);
+					if(insert)
+						cpu.addWatchpoint(address, end, access);
+					else
+						cpu.removeWatchpoint(address, end, access);
+				} else {
+					sendPacket("");
+					return false;
+				}
+				sendPacket("OK");
+				return false;
+			}
+
+			case 's':
+				if(*args)
+					cpu.reg_PC = strtoul(args, nullptr, 16);
+				if(!cpu.faulted)
+					cpu.step();
+				// step() bypasses the run loop, which would otherwise forget the breakpoint it left
+				cpu.resumeBreakpoint = -1;
+				if(cpu.faulted){
+					sendPacket("S0b");
+					return false;
+				}
+				sendPacket(cpu.HALT ? "W00" : "S05");
+				return cpu.HALT;
+			case 'c':
+				if(*args)
+					cpu.reg_PC = strtoul(args, nullptr, 16);
+				return true;
+
+			case 'k':
+				cpu.HALT = true;
+				killed = true;
+				return true;
+			case 'D':
+				sendPacket("OK");
+				connected = false;
+				return true;
+
+			case 'H':
+				sendPacket("OK");
+				return false;
+			case 'q':
+				if(packet.compare(0, 10, "qSupported") == 0)
+					sendPacket("PacketSize=1000");
+				else if(packet == "qAttached")
+					sendPacket("1");
+				else if(packet == "qC")
+					sendPacket("QC1");
+				else
+					sendPacket("");
+				return false;
+
+			default:
+				sendPacket("");
+				return false;
+		}
+	}
+
+	uint16_t readRegister(int n){
+		cpu.setFlagReg();
+		static const RegisterPairsRefs pairs[REGISTER_COUNT] = {PSW, BC, DE, HL, SP, PC};
+		return cpu.getRegister(pairs[n]);
+	}
+
+	void writeRegister(int n, uint16_t d16){
+		static const RegisterPairsRefs pairs[REGISTER_COUNT] = {PSW, BC, DE, HL, SP, PC};
+		cpu.setRegisterPair(pairs[n], d16);
+		if(pairs[n] == PSW)
+			cpu.loadFlagReg();
+	}
+
+	void sendRaw(const std::string& data){
+		std::lock_guard<std::mutex> lock(sendMutex);
+		int fd = clientFd;
+		if(fd >= 0)
+			send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+	}
+
+	void sendPacket(const std::string& payload){
+		char checksum[4];
+		snprintf(checksum, sizeof(checksum), "#%02x", packetChecksum(payload));
+		sendRaw("$" + payload + checksum);
+	}
+
+	static uint8_t packetChecksum(const std::string& payload){
+		uint8_t sum = 0;
+		for(char c : payload)
+			sum += static_cast<uint8_t>(c);
+		return sum;
+	}
+
+	static uint8_t hexValue(char c){
+		if(c >= '0' && c <= '9') return c - '0';
+		if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return 0;
+	}
+
+	static std::string hex8(uint8_t d8){
+		static const char digits[] = "0123456789abcdef";
+		return {digits[d8 >> 4], digits[d8 & 0xF]};
+	}
+
+	// Register values travel little-endian
+	static std::string hex16(uint16_t d16){
+		return hex8(d16 & 0xFF) + hex8(d16 >> 8);
+	}
+
+	static uint16_t parseHex16(const char* text){
+		uint8_t low = (hexValue(text[0]) << 4) | hexValue(text[1]);
+		uint8_t high = (hexValue(text[2]) << 4) | hexValue(text[3]);
+		return (static_cast<uint16_t>(high) << 8) | low;
+	}
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+#include "disasm.h"
+
+// Everything derived from one program image at one load address. Entries are immutable once
+// built, so any number of CPUs and threads can share them.
+struct CachedImage {
+	uint64_t hash = 0;				// imageHash() of bytes and address
+	uint16_t address = 0;
+	std::vector<uint8_t> bytes;
+	std::vector<uint8_t> fusion;	// Fusion kind starting at each byte, FUSE_UNDECODED near the end
+	CodeMap codeMap;				// analyzeCode() from the default entry points
+};
+using ImageRef = std::shared_ptr<const CachedImage>;
+
+// FNV-1a over the load address and the image bytes
+inline uint64_t imageHash(const uint8_t* data, size_t size, uint16_t address){
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	auto mix = [&](uint8_t byte){
+		hash = (hash ^ byte) * 0x100000001B3ULL;
+	};
+	mix(address & 0xFF);
+	mix(address >> 8);
+	for(size_t i = 0; i < size; i++)
+		mix(data[i]);
+	return hash;
+}
+
+// Copies an image into a CPU together with its pre-decoded superinstructions. The cached entry
+// is never written: the CPU gets its own bytes and stores hit only those, dropping the decoded
+// entries they overlap like for any other code. Returns the number of bytes loaded.
+inline size_t attachImage(CPU& cpu, const CachedImage& image){
+	size_t loaded = loadProgramFromBytes(image.bytes.data(), image.bytes.size(), cpu.memory, sizeof(cpu.memory), image.address);
+	if(!loaded)
+		return 0;
+	cpu.markDirty(image.address, loaded);
+	// Entries decoded from the old contents are stale
+	int firstPage = image.address >> 8, lastPage = (image.address + loaded - 1) >> 8;
+	for(int page = firstPage; page <= lastPage; page++)
+		cpu.clearFusionPage(page);
+	if(lastPage < 0xFF)
+		cpu.clearFusionPage(lastPage + 1);
+	for(size_t i = 0; i < loaded; i++){
+		uint16_t address = static_cast<uint16_t>(image.address + i);
+		// Banked pages show other bytes than the ones just loaded
+		if(image.fusion[i] != FUSE_UNDECODED && !(cpu.pageFlags[address >> 8] & PAGE_BANKED))
+			cpu.setFusion(address, image.fusion[i]);
+	}
+	return loaded;
+}
+
+// Process-wide cache of program images by content hash. The first load of an image decodes and
+// analyzes it, later loads of the same bytes only attach. With a directory set, entries are also
+// written there and read back by later processes.
+//
+// File layout, <directory>/<hash>.img: "8080IMG2", FUSE_COUNT, hash, address, size, bytes,
+// fusion kinds, then the code map (see writeEntry). Files that do not match are rebuilt.
+class ImageCache {
+public:
+	void setDirectory(const std::string& path){
+		std::lock_guard<std::mutex> lock(mutex);
+		directory = path;
+	}
+
+	ImageRef get(const uint8_t* data, size_t size, uint16_t address){
+		size = std::min(size, static_cast<size_t>(0x10000 - address));
+		uint64_t hash = imageHash(data, size, address);
+		std::lock_guard<std::mutex> lock(mutex);
+		auto cached = images.find(hash);
+		if(cached != images.end() && cached->second->address == address && cached->second->bytes.size() == size
+		   && std::equal(data, data + size, cached->second->bytes.begin())){
+			hits++;
+			return cached->second;
+		}
+		misses++;
+		std::shared_ptr<CachedImage> image;
+		if(!directory.empty())
+			image = readEntry(entryPath(hash), data, size, address);
+		if(!image){
+			image = build(data, size, address, hash);
+			if(!directory.empty())
+				writeEntry(entryPath(hash), *image);
+		}
+		images[hash] = image;
+		return image;
+	}
+
+	// Null when the file cannot be read
+	ImageRef getFile(const std::string& path, uint16_t address){
+		std::ifstream file(path, std::ios::binary);
+		if(!file)
+			return nullptr;
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return get(data.data(), data.size(), address);
+	}
+
+	void clear(){
+		std::lock_guard<std::mutex> lock(mutex);
+		images.clear();
+	}
+
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+private:
+	static constexpr char MAGIC[8] = {'8', '0', '8', '0', 'I', 'M', 'G', '2'};
+
+	std::map<uint64_t, ImageRef> images;
+	std::string directory;
+	std::mutex mutex;
+
+	static std::shared_ptr<CachedImage> build(const uint8_t* data, size_t size, uint16_t address, uint64_t hash){
+		auto image = std::make_shared<CachedImage>();
+		image->hash = hash;
+		image->address = address;
+		image->bytes.assign(data, data + size);
+
+		// Only sequences that end inside the image can be decoded ahead of time
+		image->fusion.assign(size, FUSE_UNDECODED);
+		for(size_t i = 0; i + FUSION_MAX_LENGTH <= size; i++)
+			image->fusion[i] = matchFusion(&image->bytes[i]);
+
+		std::vector<uint8_t> memory(0x10000, 0);
+		std::copy(data, data + size, memory.begin() + address);
+		image->codeMap = analyzeCode(memory.data(), memory.size(), address, static_cast<uint32_t>(address + size), defaultEntryPoints(address));
+		return image;
+	}
+
+	std::string entryPath(uint64_t hash) const {
+		return directory + "/" + Logger::hexString(hash >> 32, 8) + Logger::hexString(hash & 0xFFFFFFFF, 8) + ".img";
+	}
+
+	static void put(std::vector<uint8_t>& out, uint32_t value, int bytes){
+		for(int i = 0; i < bytes; i++)
+			out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+	}
+
+	static void writeEntry(const std::string& path, const CachedImage& image){
+		const CodeMap& map = image.codeMap;
+		std::vector<uint8_t> out(MAGIC, MAGIC + sizeof(MAGIC));
+		put(out, FUSE_COUNT, 1);
+		put(out, static_cast<uint32_t>(image.hash), 4);
+		put(out, static_cast<uint32_t>(image.hash >> 32), 4);
+		put(out, image.address, 2);
+		put(out, static_cast<uint32_t>(image.bytes.size()), 4);
+		out.insert(out.end(), image.bytes.begin(), image.bytes.end());
+		out.insert(out.end(), image.fusion.begin(), image.fusion.end());
+
+		put(out, map.imageEnd, 4);
+		put(out, static_cast<uint32_t>(map.blocks.size()), 4);
+		for(const auto& entry : map.blocks){
+			const BasicBlock& block = entry.second;
+			put(out, block.start, 2);
+			put(out, block.end, 4);
+			put(out, block.instructionCount, 4);
+			put(out, static_cast<uint32_t>(block.successors.size()), 4);
+			for(uint16_t successor : block.successors)
+				put(out, successor, 2);
+		}
+		put(out, static_cast<uint32_t>(map.functions.size()), 4);
+		for(uint16_t function : map.functions)
+			put(out, function, 2);
+		put(out, static_cast<uint32_t>(map.dataRegions.size()), 4);
+		for(const auto& region : map.dataRegions){
+			put(out, region.first, 2);
+			put(out, region.second, 4);
+		}
+		put(out, static_cast<uint32_t>(map.indirectJumps.size()), 4);
+		for(uint16_t site : map.indirectJumps)
+			put(out, site, 2);
+		out.insert(out.end(), map.code.begin() + image.address, map.code.begin() + image.address + image.bytes.size());
+
+		// Written under a temporary name so a concurrent reader never sees half a file
+		std::string temporary = path + ".tmp";
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if(!file)
+			return;
+		bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+		written = fclose(file) == 0 && written;
+		if(!written || rename(temporary.c_str(), path.c_str()) != 0)
+			remove(temporary.c_str());
+	}
+
+	// Bounds checked reader over a whole entry file
+	struct Reader {
+		const std::vector<uint8_t>& in;
+		size_t position = 0;
+		bool ok = true;
+		uint32_t get(int bytes){
+			uint32_t value = 0;
+			if(position + bytes > in.size()){
+				ok = false;
+				return 0;
+			}
+			for(int i = 0; i < bytes; i++)
+				value |= static_cast<uint32_t>(in[position++]) << (i * 8);
+			return value;
+		}
+		bool copy(std::vector<uint8_t>& out, size_t size){
+			if(position + size > in.size())
+				return ok = false;
+			out.assign(in.begin() + position, in.begin() + position + size);
+			position += size;
+			return true;
+		}
+	};
+
+	// Null unless the file holds an entry for exactly these bytes
+	static std::shared_ptr<CachedImage> readEntry(const std::string& path, const uint8_t* data, size_t size, uint16_t address){
+		std::ifstream file(path, std::ios::binary);
+		if(!file)
+			return nullptr;
+		std::vector<uint8_t> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if(in.size() < sizeof(MAGIC) || !std::equal(MAGIC, MAGIC + sizeof(MAGIC), in.begin()))
+			return nullptr;
+
+		Reader reader{in, sizeof(MAGIC)};
+		auto image = std::make_shared<CachedImage>();
+		if(reader.get(1) != FUSE_COUNT)
+			return nullptr;
+		image->hash = reader.get(4);
+		image->hash |= static_cast<uint64_t>(reader.get(4)) << 32;
+		image->address = reader.get(2);
+		if(image->address != address || reader.get(4) != size || !reader.copy(image->bytes, size)
+		   || !std::equal(data, data + size, image->bytes.begin()) || !reader.copy(image->fusion, size))
+			return nullptr;
+
+		CodeMap& map = image->codeMap;
+		map.imageStart = address;
+		map.imageEnd = reader.get(4);
+		for(uint32_t count = reader.get(4); reader.ok && count > 0; count--){
+			BasicBlock block;
+			block.start = reader.get(2);
+			block.end = reader.get(4);
+			block.instructionCount = reader.get(4);
+			for(uint32_t successors = reader.get(4); reader.ok && successors > 0; successors--)
+				block.successors.push_back(reader.get(2));
+			map.blocks[block.start] = block;
+		}
+		for(uint32_t count = reader.get(4); reader.ok && count > 0; count--)
+			map.functions.insert(reader.get(2));
+		for(uint32_t count = reader.get(4); reader.ok && count > 0; count--){
+			uint16_t start = reader.get(2);
+			map.dataRegions.push_back({start, reader.get(4)});
+		}
+		for(uint32_t count = reader.get(4); reader.ok && count > 0; count--)
+			map.indirectJumps.push_back(reader.get(2));
+		std::vector<uint8_t> code;
+		if(!reader.copy(code, size) || reader.position != in.size())
+			return nullptr;
+		std::copy(code.begin(), code.end(), map.code.begin() + address);
+		return image;
+	}
+};
+
+inline ImageCache& imageCache(){
+	static ImageCache cache;
+	return cache;
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum LogLevel {
+	LOG_ERROR	= 0,
+	LOG_WARN	= 1,
+	LOG_INFO	= 2,
+	LOG_DEBUG	= 3,
+	LOG_TRACE	= 4		// per-instruction records, register and memory dumps
+};
+
+enum LogFormat {
+	LOG_TEXT,	// human readable
+	LOG_JSON,	// one JSON object per line
+	LOG_CSV		// "type,field,..." rows, a header row the first time a record type is seen
+};
+
+// Named value of a structured record. Text output shows numbers as hex padded to hexDigits
+// (decimal when 0), JSON and CSV always write them as plain decimal numbers.
+struct LogField {
+	const char* name;
+	uint64_t value;
+	uint8_t hexDigits = 0;
+	const char* text = nullptr;		// string value instead of a number
+};
+
+// Buffered log sink. Everything is formatted by hand into a large user-space buffer which
+// is written out with a single fwrite when it fills up, errors are written out immediately.
+//
+// Safe to use from several threads: records and messages are emitted whole under the lock.
+// A line built from several raw appender calls needs lock() held around it to stay in one
+// piece when other threads log at the same time.
+class Logger {
+public:
+	static constexpr size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+	explicit Logger(FILE* output = stdout, size_t bufferSize = DEFAULT_BUFFER_SIZE)
+		: output(output), buffer(bufferSize) {}
+	~Logger(){
+		flush();
+	}
+
+	void setLevel(LogLevel level){ this->level.store(level, std::memory_order_relaxed); }
+	void setFormat(LogFormat format){ this->format.store(format, std::memory_order_relaxed); }
+	LogFormat getFormat() const { return format.load(std::memory_order_relaxed); }
+	bool enabled(LogLevel level) const { return level <= this->level.load(std::memory_order_relaxed); }
+	void setOutput(FILE* output){
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		flush();
+		this->output = output;
+	}
+
+	std::unique_lock<std::recursive_mutex> lock(){
+		return std::unique_lock<std::recursive_mutex>(mutex);
+	}
+
+	void flush(){
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		if(used > 0 && output){
+			fwrite(buffer.data(), 1, used, output);
+			fflush(output);
+		}
+		used = 0;
+	}
+
+	// Raw appenders, callers finish a line with endLine()
+	Logger& put(char c){
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		reserve(1);
+		buffer[used++] = c;
+		return *this;
+	}
+	Logger& put(const char* text, size_t length){
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		if(length > buffer.size()){
+			flush();
+			fwrite(text, 1, length, output);
+			return *this;
+		}
+		reserve(length);
+		memcpy(buffer.data() + used, text, length);
+		used += length;
+		return *this;
+	}
+	Logger& put(const char* text){
+		return put(text, strlen(text));
+	}
+	Logger& put(const std::string& text){
+		return put(text.data(), text.size());
+	}
+	Logger& hex(uint64_t value, int digits){
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		reserve(digits);
+		writeHex(buffer.data() + used, value, digits);
+		used += digits;
+		return *this;
+	}
+	Logger& bin(uint64_t value, int digits){
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		reserve(digits);
+		for(int i = digits - 1; i >= 0; i--)
+			buffer[used++] = '0' + ((value >> i) & 1);
+		return *this;
+	}
+	Logger& dec(uint64_t value){
+		char digits[20];
+		int count = 0;
+		do {
+			digits[count++] = '0' + value % 10;
+			value /= 10;
+		} while(value);
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		reserve(count);
+		while(count)
+			buffer[used++] = digits[--count];
+		return *this;
+	}
+	void endLine(LogLevel level = LOG_INFO){
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		put('\n');
+		if(level == LOG_ERROR)
+			flush();
+	}
+
+	// Free text message, in JSON/CSV it becomes a "message" record
+	void message(LogLevel level, const std::string& text){
+		if(!enabled(level))
+			return;
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		if(getFormat() == LOG_TEXT){
+			if(level == LOG_ERROR)
+				put("Error: ");
+			else if(level == LOG_WARN)
+				put("Warning: ");
+			put(text).endLine(level);
+			return;
+		}
+		record(level, "message", {{"level", static_cast<uint64_t>(level)}, {"text", 0, 0, text.c_str()}});
+	}
+	void error(const std::string& text){ message(LOG_ERROR, text); }
+	void warn(const std::string& text){ message(LOG_WARN, text); }
+	void info(const std::string& text){ message(LOG_INFO, text); }
+
+	// Structured record, e.g. record(LOG_TRACE, "step", {{"pc", pc, 4}, {"opcode", op, 2}})
+	void record(LogLevel level, const char* type, std::initializer_list<LogField> fields){
+		if(!enabled(level))
+			return;
+		std::lock_guard<std::recursive_mutex> guard(mutex);
+		switch(getFormat()){
+			case LOG_TEXT:
+				put(type);
+				for(const LogField& field : fields){
+					put(' ').put(field.name).put('=');
+					if(field.text)
+						put(field.text);
+					else if(field.hexDigits)
+						put("0x").hex(field.value, field.hexDigits);
+					else
+						dec(field.value);
+				}
+				break;
+			case LOG_JSON: {
+				put("{\"type\":\"").put(type).put('"');
+				for(const LogField& field : fields){
+					put(",\"").put(field.name).put("\":");
+					if(field.text)
+						putJsonString(field.text);
+					else
+						dec(field.value);
+				}
+				put('}');
+				break;
+			}
+			case LOG_CSV:
+				if(csvHeaders.insert(type)){
+					put("type");
+					for(const LogField& field : fields)
+						put(',').put(field.name);
+					put('\n');
+				}
+				put(type);
+				for(const LogField& field : fields){
+					put(',');
+					if(field.text)
+						putCsvString(field.text);
+					else
+						dec(field.value);
+				}
+				break;
+		}
+		endLine(level);
+	}
+
+	static std::string hexString(uint64_t value, int digits){
+		std::string text(digits, '0');
+		writeHex(&text[0], value, digits);
+		return text;
+	}
+
+	// Fixed-width upper case hex, no terminator
+	static void writeHex(char* out, uint64_t value, int digits){
+		static const char hexDigits[] = "0123456789ABCDEF";
+		for(int i = digits - 1; i >= 0; i--){
+			out[i] = hexDigits[value & 0xF];
+			value >>= 4;
+		}
+	}
+
+private:
+	FILE* output;
+	std::vector<char> buffer;
+	size_t used = 0;
+	std::atomic<LogLevel> level{LOG_INFO};
+	std::atomic<LogFormat> format{LOG_TEXT};
+	std::recursive_mutex mutex;
+
+	// Record types that already got their CSV header row
+	struct {
+		std::vector<std::string> seen;
+		bool insert(const char* type){
+			for(const std::string& name : seen)
+				if(name == type)
+					return false;
+			seen.push_back(type);
+			return true;
+		}
+	} csvHeaders;
+
+	void reserve(size_t length){
+		if(used + length > buffer.size())
+			flush();
+	}
+
+	void putJsonString(const char* text){
+		put('"');
+		for(const char* c = text; *c; c++){
+			if(*c == '"' || *c == '\\'){
+				put('\\').put(*c);
+			} else if(static_cast<uint8_t>(*c) < 0x20){
+				put("\\u00").hex(static_cast<uint8_t>(*c), 2);
+			} else {
+				put(*c);
+			}
+		}
+		put('"');
+	}
+
+	void putCsvString(const char* text){
+		put('"');
+		for(const char* c = text; *c; c++){
+			if(*c == '"')
+				put('"');
+			put(*c);
+		}
+		put('"');
+	}
+};
+
+// Process-wide sink used by the core's print functions
+inline Logger& logger(){
+	static Logger instance;
+	return instance;
+}
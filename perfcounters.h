@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "cpu.h"
+
+// Counters of one running instance in a POSIX shared memory segment, so a monitor can watch a
+// live emulator without touching its output or stopping it. There is one writer per block: the
+// thread that runs the CPU updates it between slices. Readers never block the writer, they
+// retry when they catch it in the middle of an update (sequence is odd then).
+//
+// All values are running totals, the reader turns two snapshots into rates.
+struct PerfBlock {
+	static constexpr uint32_t VERSION = 1;
+
+	char magic[8];							// "8080PERF"
+	uint32_t version;
+	uint32_t pid;
+	std::atomic<uint64_t> sequence;
+	std::atomic<uint64_t> wallNanos;		// CLOCK_MONOTONIC at the last update
+	std::atomic<uint64_t> hostCpuNanos;		// CPU time used by the writing thread
+	std::atomic<uint64_t> instructions;
+	std::atomic<uint64_t> cycles;			// T-states
+	std::atomic<uint64_t> interrupts;
+	std::atomic<uint64_t> portAccesses;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "PerfBlock needs lock-free 64-bit atomics");
+
+// Plain copy of a PerfBlock
+struct PerfSnapshot {
+	uint32_t pid = 0;
+	uint64_t wallNanos = 0;
+	uint64_t hostCpuNanos = 0;
+	uint64_t instructions = 0;
+	uint64_t cycles = 0;
+	uint64_t interrupts = 0;
+	uint64_t portAccesses = 0;
+};
+
+inline uint64_t clockNanos(clockid_t clock){
+	timespec now;
+	clock_gettime(clock, &now);
+	return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+}
+
+// Writer side. Creates (or takes over) the segment /name.
+class PerfExporter {
+public:
+	PerfExporter() = default;
+	PerfExporter(const PerfExporter&) = delete;
+	PerfExporter& operator=(const PerfExporter&) = delete;
+	~PerfExporter(){
+		close();
+	}
+
+	bool open(const std::string& name){
+		close();
+		int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+		if(fd < 0)
+			return false;
+		if(ftruncate(fd, sizeof(PerfBlock)) != 0){
+			::close(fd);
+			return false;
+		}
+		void* mapped = mmap(nullptr, sizeof(PerfBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(mapped == MAP_FAILED)
+			return false;
+		block = static_cast<PerfBlock*>(mapped);
+		segment = name;
+		memcpy(block->magic, "8080PERF", sizeof(block->magic));
+		block->version = PerfBlock::VERSION;
+		block->pid = static_cast<uint32_t>(getpid());
+		// A writer killed in the middle of an update leaves an odd sequence behind
+		block->sequence.store(0, std::memory_order_release);
+		base = {};
+		total = {};
+		return true;
+	}
+
+	// Removes the segment, readers that still have it mapped keep the last values
+	void close(){
+		if(!block)
+			return;
+		munmap(block, sizeof(PerfBlock));
+		shm_unlink(segment.c_str());
+		block = nullptr;
+	}
+
+	// Adds what cpu did since the last call. Call it from the thread running cpu, at a slice
+	// boundary. A CPU that was replaced or reset to fresh counters starts a new base.
+	void publish(const CPU& cpu){
+		if(!block)
+			return;
+		PerfSnapshot now;
+		now.instructions = cpu.instructions;
+		now.cycles = cpu.cyclesBeforeReset + cpu.cycles;
+		now.interrupts = cpu.interruptsTaken;
+		now.portAccesses = cpu.portAccesses;
+		if(&cpu != lastCpu || now.instructions < base.instructions || now.cycles < base.cycles)
+			base = {};
+		lastCpu = &cpu;
+		total.instructions += now.instructions - base.instructions;
+		total.cycles += now.cycles - base.cycles;
+		total.interrupts += now.interrupts - base.interrupts;
+		total.portAccesses += now.portAccesses - base.portAccesses;
+		base = now;
+
+		uint64_t wall = clockNanos(CLOCK_MONOTONIC);
+		uint64_t hostCpu = clockNanos(CLOCK_THREAD_CPUTIME_ID);
+		uint64_t sequence = block->sequence.load(std::memory_order_relaxed);
+		block->sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		block->wallNanos.store(wall, std::memory_order_relaxed);
+		block->hostCpuNanos.store(hostCpu, std::memory_order_relaxed);
+		block->instructions.store(total.instructions, std::memory_order_relaxed);
+		block->cycles.store(total.cycles, std::memory_order_relaxed);
+		block->interrupts.store(total.interrupts, std::memory_order_relaxed);
+		block->portAccesses.store(total.portAccesses, std::memory_order_relaxed);
+		block->sequence.store(sequence + 2, std::memory_order_release);
+	}
+
+private:
+	PerfBlock* block = nullptr;
+	std::string segment;
+	const CPU* lastCpu = nullptr;
+	PerfSnapshot base;		// CPU counters at the last publish
+	PerfSnapshot total;
+};
+
+// Reader side, maps /name read-only
+class PerfReader {
+public:
+	PerfReader() = default;
+	PerfReader(const PerfReader&) = delete;
+	PerfReader& operator=(const PerfReader&) = delete;
+	~PerfReader(){
+		if(block)
+			munmap(const_cast<PerfBlock*>(block), sizeof(PerfBlock));
+	}
+
+	bool open(const std::string& name){
+		int fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if(fd < 0)
+			return false;
+		void* mapped = mmap(nullptr, sizeof(PerfBlock), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if(mapped == MAP_FAILED)
+			return false;
+		block = static_cast<const PerfBlock*>(mapped);
+		if(memcmp(block->magic, "8080PERF", sizeof(block->magic)) != 0 || block->version != PerfBlock::VERSION){
+			munmap(const_cast<PerfBlock*>(block), sizeof(PerfBlock));
+			block = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+	// Consistent copy of the block, retried while the writer is updating it. False when the
+	// block stays in the middle of an update (writer killed during one).
+	bool read(PerfSnapshot& snapshot) const {
+		uint64_t before, after;
+		int tries = 0;
+		do {
+			if(tries++ == MAX_TRIES)
+				return false;
+			before = block->sequence.load(std::memory_order_acquire);
+			snapshot.pid = block->pid;
+			snapshot.wallNanos = block->wallNanos.load(std::memory_order_relaxed);
+			snapshot.hostCpuNanos = block->hostCpuNanos.load(std::memory_order_relaxed);
+			snapshot.instructions = block->instructions.load(std::memory_order_relaxed);
+			snapshot.cycles = block->cycles.load(std::memory_order_relaxed);
+			snapshot.interrupts = block->interrupts.load(std::memory_order_relaxed);
+			snapshot.portAccesses = block->portAccesses.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = block->sequence.load(std::memory_order_relaxed);
+		} while((before & 1) || before != after);
+		return true;
+	}
+
+private:
+	static constexpr int MAX_TRIES = 100000;
+	const PerfBlock* block = nullptr;
+};
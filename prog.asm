@@ -0,0 +1,28 @@
+; Source of prog.bin : bubble sort of the COUNT + 1 bytes at DATA
+; ./cpu --asm prog.asm
+
+COUNT	EQU 4
+DATA	EQU 3000H
+
+		ORG 0000H
+		LXI H, DATA
+		MVI D, COUNT
+outer:	LXI H, DATA
+		MVI C, COUNT
+inner:	MOV A,M			; compare two neighbours
+		INX H
+		MOV B,M
+		CMP B
+		JC skip
+		MOV M,A			; swap them
+		DCX H
+		MOV M,B
+		INX H
+skip:	DCR C
+		JNZ inner
+		DCR D
+		JNZ outer
+		HLT
+
+		ORG DATA
+		DB 05H, 02H, 04H, 01H, 03H
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Events of an input log
+enum ReplayEvent : uint8_t {
+	EVENT_IN		= 0,	// IN instruction: port, value
+	EVENT_INTERRUPT	= 1		// interrupt taken: RST vector
+};
+
+// Record/replay of everything the CPU gets from the outside world: IN results and interrupts,
+// each stamped with the T-state count it happened at. A recorded run can then be replayed
+// without any device emulation and follows exactly the same path.
+//
+// File layout: "8080LOG1", then per event a varint cycle delta from the previous event,
+// the event type, the port or vector and, for EVENT_IN, the value read.
+class InputLog {
+public:
+	enum Mode { OFF, RECORD, REPLAY };
+
+	InputLog() = default;
+	InputLog(const InputLog&) = delete;
+	InputLog& operator=(const InputLog&) = delete;
+	~InputLog(){
+		close();
+	}
+
+	Mode getMode() const { return mode; }
+	bool recording() const { return mode == RECORD; }
+	bool replaying() const { return mode == REPLAY; }
+	// Replay ran out of events or the program asked for something the log does not have
+	bool diverged() const { return divergence; }
+
+	bool startRecording(const std::string& path){
+		close();
+		output = fopen(path.c_str(), "wb");
+		if(!output)
+			return false;
+		fwrite(MAGIC, 1, sizeof(MAGIC), output);
+		mode = RECORD;
+		lastCycle = 0;
+		return true;
+	}
+
+	bool startReplay(const std::string& path){
+		close();
+		FILE* input = fopen(path.c_str(), "rb");
+		if(!input)
+			return false;
+		char magic[sizeof(MAGIC)];
+		bool valid = fread(magic, 1, sizeof(magic), input) == sizeof(magic) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+		uint8_t chunk[4096];
+		size_t count;
+		while(valid && (count = fread(chunk, 1, sizeof(chunk), input)) > 0)
+			data.insert(data.end(), chunk, chunk + count);
+		fclose(input);
+		if(!valid){
+			data.clear();
+			return false;
+		}
+		mode = REPLAY;
+		position = 0;
+		lastCycle = 0;
+		divergence = false;
+		decodeNext();
+		return true;
+	}
+
+	void close(){
+		if(output){
+			flushBuffer();
+			fclose(output);
+			output = nullptr;
+		}
+		data.clear();
+		mode = OFF;
+	}
+
+	void recordInput(uint64_t cycle, uint8_t port, uint8_t value){
+		if(mode != RECORD)
+			return;
+		writeEvent(cycle, EVENT_IN, port);
+		buffer.push_back(value);
+	}
+	void recordInterrupt(uint64_t cycle, uint8_t vector){
+		writeEvent(cycle, EVENT_INTERRUPT, vector);
+	}
+
+	// Value of the IN on port at this cycle, false if the log disagrees
+	bool nextInput(uint64_t cycle, uint8_t port, uint8_t& value){
+		if(!pending || next.type != EVENT_IN || next.cycle != cycle || next.operand != port){
+			divergence = true;
+			return false;
+		}
+		value = next.value;
+		decodeNext();
+		return true;
+	}
+	// Interrupt recorded at this cycle, if any
+	bool interruptDue(uint64_t cycle, uint8_t& vector){
+		if(!pending || next.type != EVENT_INTERRUPT || next.cycle != cycle)
+			return false;
+		vector = next.operand;
+		decodeNext();
+		return true;
+	}
+	// Cycle of the next recorded event, UINT64_MAX when the log is exhausted
+	uint64_t nextEventCycle() const {
+		return pending ? next.cycle : UINT64_MAX;
+	}
+	// Cycle of the next recorded event if it is an interrupt, UINT64_MAX otherwise
+	uint64_t nextInterruptCycle() const {
+		return pending && next.type == EVENT_INTERRUPT ? next.cycle : UINT64_MAX;
+	}
+
+private:
+	static constexpr char MAGIC[8] = {'8', '0', '8', '0', 'L', 'O', 'G', '1'};
+	static constexpr size_t FLUSH_SIZE = 1 << 16;
+
+	struct Event {
+		uint64_t cycle;
+		uint8_t type;
+		uint8_t operand;
+		uint8_t value;
+	};
+
+	Mode mode = OFF;
+	FILE* output = nullptr;
+	std::vector<uint8_t> buffer;	// pending writes while recording
+	std::vector<uint8_t> data;		// whole log while replaying
+	size_t position = 0;
+	uint64_t lastCycle = 0;
+	Event next = {};
+	bool pending = false;
+	bool divergence = false;
+
+	void writeEvent(uint64_t cycle, uint8_t type, uint8_t operand){
+		if(mode != RECORD)
+			return;
+		if(buffer.size() >= FLUSH_SIZE)
+			flushBuffer();
+		uint64_t delta = cycle - lastCycle;
+		lastCycle = cycle;
+		do {
+			buffer.push_back((delta & 0x7F) | (delta > 0x7F ? 0x80 : 0));
+			delta >>= 7;
+		} while(delta);
+		buffer.push_back(type);
+		buffer.push_back(operand);
+	}
+
+	void flushBuffer(){
+		if(!buffer.empty())
+			fwrite(buffer.data(), 1, buffer.size(), output);
+		buffer.clear();
+	}
+
+	// Loads the following event into next, pending is false at the end of a (truncated) log
+	void decodeNext(){
+		pending = false;
+		uint64_t delta = 0;
+		int shift = 0;
+		while(position < data.size() && shift < 64){
+			uint8_t byte = data[position++];
+			delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			shift += 7;
+			if(!(byte & 0x80)){
+				shift = -1;
+				break;
+			}
+		}
+		if(shift != -1 || position + 2 > data.size())
+			return;
+		next.cycle = lastCycle + delta;
+		next.type = data[position++];
+		next.operand = data[position++];
+		if(next.type == EVENT_IN){
+			if(position >= data.size())
+				return;
+			next.value = data[position++];
+		} else if(next.type != EVENT_INTERRUPT){
+			return;
+		}
+		lastCycle = next.cycle;
+		pending = true;
+	}
+};
@@ -0,0 +1,123 @@
+// Multi-core Board schedules, run by ctest
+
+#include <cstring>
+#include "check.h"
+#include "assembler.h"
+#include "board.h"
+
+// A writes a running count into the shared window, B keeps copying what it sees there into
+// its private memory at 1000H
+static const char* WRITER = "MVI A, 0\nloop: INR A\nSTA 8000H\nJMP loop\n";
+static const char* READER = "LXI H, 1000H\nloop: LDA 8000H\nMOV M,A\nINX H\nJMP loop\n";
+
+struct SharedPair {
+	CPU writer, reader;
+	BankStore store;
+	Board board{1000};
+
+	SharedPair(){
+		store.allocate(0x100);
+		assemble(WRITER, writer);
+		assemble(READER, reader);
+		board.addCore(writer);
+		board.addCore(reader);
+		CHECK(board.shareMemory(store, 0x8000, 0x100));
+	}
+	uint16_t logged(){
+		return reader.getRegister(HL) - 0x1000;
+	}
+};
+
+// Within a quantum the writer has run to its end before the reader starts, so every value
+// the reader loads in one quantum is the one the writer left, and both see the same storage
+static void testSharedWindowQuanta(){
+	SharedPair pair;
+	uint8_t previous = 0;
+	uint16_t first = 0;
+	for(int quantum = 0; quantum < 5; quantum++){
+		CHECK(pair.board.run(1000) == 1000);
+		uint8_t shared = pair.store.data()[0];
+		CHECK(shared > previous);
+		CHECK(pair.writer.peekByte(0x8000) == shared && pair.reader.peekByte(0x8000) == shared);
+		uint16_t last = pair.logged();
+		CHECK(last > first);
+		// The first store of a quantum can still hold a load from the one before
+		for(uint16_t i = first; i < last; i++)
+			CHECK(pair.reader.memory[0x1000 + i] == shared || (i == first && pair.reader.memory[0x1000 + i] == previous));
+		CHECK(pair.reader.memory[0x1000 + last - 1] == shared);
+		first = last;
+		previous = shared;
+	} 
+	CHECK(pair.board.now == 5000);
+}
+
+// Same programs, same quantum: the same interleaving down to the byte
+static void testDeterministicInterleaving(){
+	SharedPair one, two;
+	one.board.run(20000);
+	two.board.run(20000);
+	CHECK(one.logged() == two.logged());
+	CHECK(memcmp(one.reader.memory, two.reader.memory, sizeof(one.reader.memory)) == 0);
+	CHECK(one.writer.cycles == two.writer.cycles && one.reader.cycles == two.reader.cycles);
+}
+
+// Counts B down from count, then halts
+static void countdown(CPU& cpu, int count){
+	cpu.reset();
+	CHECK(assemble("MVI B, " + std::to_string(count) + "\nLXI D, 0\nloop: INX D\nDCR B\nJNZ loop\nHLT\n", cpu).ok);
+}
+
+// runParallel returns at the first quantum boundary after every core halted
+static void testParallelEndsWhenHalted(){
+	CPU fast, slow;
+	countdown(fast, 10);
+	countdown(slow, 200);
+	Board board(500);
+	board.addCore(fast);
+	board.addCore(slow);
+	uint64_t ran = board.runParallel(1000000000);
+	CHECK(fast.HALT && slow.HALT);
+	CHECK(fast.getRegister(DE) == 10 && slow.getRegister(DE) == 200);
+	CHECK(ran < 10000 && ran % 500 == 0 && ran == board.now);
+	// The slow core halted in the last quantum
+	CHECK(slow.cycles > ran - 500 && slow.cycles <= ran);
+
+	// Both halted: run() does not start a quantum, runParallel() stops after the first
+	CHECK(board.run(1000000) == 0);
+	CHECK(board.runParallel(1000000) == 500);
+}
+
+// Code in a shared window is never fused: another core patching it must be seen at once
+static void testPatchedSharedCode(){
+	CPU patcher, runner;
+	patcher.reset();
+	runner.reset();
+	BankStore store;
+	CHECK(store.allocate(0x100));
+	Board board;
+	board.addCore(patcher);
+	board.addCore(runner);
+	CHECK(board.shareMemory(store, 0x8000, 0x100));
+	// LXI H, 1234H; MVI B, 01H; HLT; DB 0; HLT, written by the host straight into the store
+	const uint8_t code[] = {LXI_H_D16, 0x34, 0x12, MVI_B_D8, 0x01, HLT, 0x00, HLT};
+	memcpy(store.data(), code, sizeof(code));
+	CHECK(assemble("JMP 8000H\n", runner).ok);
+	CHECK(runner.run_for(1000).reason == StopReason::HALTED && runner.reg_B == 0x01);
+	CHECK(runner.fusion[0x8000] != FUSE_LXI_MVI);
+
+	// The MVI opcode becomes a NOP, its operand an LXI B
+	CHECK(assemble("MVI A, 0\nSTA 8003H\nHLT\n", patcher).ok);
+	CHECK(patcher.run_for(1000).reason == StopReason::HALTED);
+	runner.resetRegisters();
+	CHECK(runner.run_for(1000).reason == StopReason::HALTED);
+	CHECK(runner.reg_B == 0x00 && runner.reg_C == 0x76 && runner.reg_PC == 0x8008);
+}
+
+int main(){
+	logger().setLevel(LOG_ERROR);
+	testSharedWindowQuanta();
+	testDeterministicInterleaving();
+	testParallelEndsWhenHalted();
+	testPatchedSharedCode();
+	return checkResult("board_test");
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks for the test programs in this directory. A failed check is reported and counted, the
+// program keeps going and exits with a failure status at the end (see checkResult()).
+inline int& checkFailures(){
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) do { if(!(condition)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); checkFailures()++; } } while(0)
+
+inline int checkResult(const char* name){
+	if(checkFailures())
+		fprintf(stderr, "%s: %d check(s) failed\n", name, checkFailures());
+	return checkFailures() ? 1 : 0;
+}
@@ -0,0 +1,552 @@
+// Behaviour checks of the core and the tools around it, run by ctest
+
+#include <thread>
+#include <unistd.h>
+#include "check.h"
+#include "cpu.h"
+#include "disasm.h"
+#include "assembler.h"
+#include "perfcounters.h"
+
+// A breakpoint must be reported even when a run only starts on it because the previous
+// slice ended there, and a stopped breakpoint must be continuable
+static void testBreakpointsInSlices(){
+	CPU cpu;
+	cpu.reset();
+	uint8_t loop[] = {NOP, NOP, NOP, JMP_A16, 0x00, 0x00};
+	loadProgramFromBytes(loop, sizeof(loop), cpu.memory, sizeof(cpu.memory), 0x0000);
+	cpu.addBreakpoint(0x0002);
+	int hits = 0;
+	for(int i = 0; i < 100; i++){
+		RunResult result = cpu.run_for(8);
+		if(result.reason == StopReason::BREAKPOINT){
+			CHECK(result.address == 0x0002 && cpu.reg_PC == 0x0002);
+			hits++;
+		} 
+	} 
+	CHECK(hits > 0);
+
+	// Continuing from the stop runs the breakpoint instruction, the next pass stops again
+	cpu.resetRegisters();
+	CHECK(cpu.run_for(1000).reason == StopReason::BREAKPOINT);
+	uint64_t before = cpu.cycles;
+	RunResult again = cpu.run_for(1000);
+	CHECK(again.reason == StopReason::BREAKPOINT && again.address == 0x0002);
+	CHECK(cpu.cycles - before == 4 + 10 + 4 + 4);
+}
+
+static void testXthl(){
+	CPU cpu;
+	cpu.reset();
+	// LXI SP,2000H; LXI H,1234H; XTHL
+	uint8_t program[] = {LXI_SP_D16, 0x00, 0x20, LXI_H_D16, 0x34, 0x12, XTHL};
+	loadProgramFromBytes(program, sizeof(program), cpu.memory, sizeof(cpu.memory), 0x0000);
+	cpu.memory[0x2000] = 0xCD;
+	cpu.memory[0x2001] = 0xAB;
+	cpu.run_for(10 + 10 + 18);
+	CHECK(cpu.getRegister(HL) == 0xABCD);
+	CHECK(cpu.memory[0x2000] == 0x34 && cpu.memory[0x2001] == 0x12);
+	CHECK(cpu.reg_SP == 0x2000 && cpu.reg_PC == 0x0007);
+	CHECK(disassemble(cpu.memory, sizeof(cpu.memory), 0x0006) == "XTHL");
+}
+
+// An image that ends at the top of memory is analyzed up to and including 0xFFFF
+static void testCodeMapTopOfMemory(){
+	std::vector<uint8_t> memory(0x10000, 0);
+	memory[0xFFFE] = NOP;
+	memory[0xFFFF] = HLT;
+	CodeMap map = analyzeCode(memory.data(), memory.size(), 0xFFFE, 0x10000, {0xFFFE});
+	CHECK(map.code[0xFFFF] == 1);
+	CHECK(map.blocks.count(0xFFFE) && map.blocks[0xFFFE].end == 0x10000 && map.blocks[0xFFFE].instructionCount == 2);
+	CHECK(map.dataRegions.empty());
+}
+
+// Code assembled over code that already ran must not run stale superinstructions, and the
+// baseline reset must know about the new bytes
+static void testAssembleOverRunCode(){
+	CPU cpu;
+	cpu.reset();
+	cpu.setBaseline();
+	CHECK(assemble("MVI B, 3\nloop: DCR B\nJNZ loop\nHLT\n", cpu).ok);
+	CHECK(cpu.run_for(1000).reason == StopReason::HALTED);
+	CHECK(cpu.fusion[0x0002] == FUSE_DCR_JNZ);
+
+	// Same place, DCR B; JNZ becomes DCR C; JZ
+	cpu.resetRegisters();
+	CHECK(assemble("MVI B, 3\nloop: DCR C\nJZ loop\nHLT\n", cpu).ok);
+	CHECK(cpu.run_for(1000).reason == StopReason::HALTED);
+	CHECK(cpu.reg_B == 3 && cpu.reg_C == 0xFF);
+
+	cpu.resetToBaseline();
+	CHECK(cpu.memory[0x0000] == 0 && cpu.memory[0x0002] == 0);
+}
+
+// Records from several threads come out whole, also when the buffer fills up in between
+static void testLoggerThreads(){
+	FILE* file = tmpfile();
+	{
+		Logger log(file, 256);
+		std::vector<std::thread> threads;
+		for(int t = 0; t < 4; t++)
+			threads.emplace_back([&log, t]{
+				for(int i = 0; i < 2000; i++)
+					log.record(LOG_INFO, "line", {{"thread", static_cast<uint64_t>(t)}, {"index", static_cast<uint64_t>(i), 4}});
+			});
+		for(std::thread& thread : threads)
+			thread.join();
+	} 
+	rewind(file);
+	char line[128];
+	int lines = 0, broken = 0;
+	while(fgets(line, sizeof(line), file)){
+		unsigned thread, index;
+		char end;
+		if(sscanf(line, "line thread=%u index=0x%4X%c", &thread, &index, &end) != 3 || end != '\n' || thread > 3)
+			broken++;
+		lines++;
+	} 
+	fclose(file);
+	CHECK(lines == 4 * 2000);
+	CHECK(broken == 0);
+}
+
+// Runs source and returns its PSW, pushed by a trailing PUSH PSW: A << 8 | flags
+static uint16_t pswAfter(const std::string& source){
+	CPU cpu;
+	cpu.reset();
+	CHECK(assemble("LXI SP, 0F000H\n" + source + "\nPUSH PSW\nHLT\n", cpu).ok);
+	CHECK(cpu.run_for(10000).reason == StopReason::HALTED);
+	return static_cast<uint16_t>(cpu.memory[0xEFFF] << 8 | cpu.memory[0xEFFE]);
+}
+
+// S Z AC P CY of the accumulator instructions, bit 1 and the unused bits are not checked
+static void testAluFlags(){
+	constexpr uint8_t S = 0x80, Z = 0x40, AC = 0x10, P = 0x04, CY = 0x01;
+	auto flags = [](uint16_t psw){
+		return psw & (S | Z | AC | P | CY);
+	};
+	uint16_t psw = pswAfter("MVI A, 0FFH\nADI 1");
+	CHECK(psw >> 8 == 0x00 && flags(psw) == (Z | AC | P | CY));
+	// Subtraction sets CY on a borrow
+	psw = pswAfter("MVI A, 05H\nSUI 06H");
+	CHECK(psw >> 8 == 0xFF && flags(psw) == (S | P | CY));
+	psw = pswAfter("MVI A, 3AH\nMVI B, 3AH\nCMP B");
+	CHECK(psw >> 8 == 0x3A && flags(psw) == (Z | AC | P));
+	psw = pswAfter("MVI A, 3AH\nCPI 3BH");
+	CHECK(psw >> 8 == 0x3A && flags(psw) == (S | P | CY));
+	// ANA takes AC from bit 3 of the operands, the logical ops clear CY
+	psw = pswAfter("MVI A, 0FFH\nADI 1\nMVI A, 0F0H\nMVI B, 08H\nANA B");
+	CHECK(psw >> 8 == 0x00 && flags(psw) == (Z | AC | P));
+	psw = pswAfter("MVI A, 0FFH\nADI 1\nMVI A, 0F0H\nXRI 0F1H");
+	CHECK(psw >> 8 == 0x01 && flags(psw) == 0);
+	psw = pswAfter("MVI A, 80H\nORI 01H");
+	CHECK(psw >> 8 == 0x81 && flags(psw) == (S | P));
+	// Carry in of ADC and SBB
+	psw = pswAfter("MVI A, 0FFH\nADI 1\nMVI A, 10H\nACI 0");
+	CHECK(psw >> 8 == 0x11 && flags(psw) == P);
+	psw = pswAfter("MVI A, 0FFH\nADI 1\nMVI A, 10H\nSBI 0");
+	CHECK(psw >> 8 == 0x0F && flags(psw) == P);
+	// INR and DCR leave CY alone
+	psw = pswAfter("MVI A, 0FFH\nADI 1\nMVI A, 7FH\nINR A");
+	CHECK(psw >> 8 == 0x80 && (psw & (S | Z | P | CY)) == (S | CY));
+	psw = pswAfter("MVI A, 01H\nDCR A");
+	CHECK(psw >> 8 == 0x00 && (psw & (S | Z | P | CY)) == (Z | P));
+	// Rotates move bits through or around CY and leave the other flags alone
+	psw = pswAfter("MVI A, 81H\nRLC");
+	CHECK(psw >> 8 == 0x03 && flags(psw) == CY);
+	psw = pswAfter("MVI A, 01H\nRRC");
+	CHECK(psw >> 8 == 0x80 && flags(psw) == CY);
+	psw = pswAfter("MVI A, 80H\nRAL");
+	CHECK(psw >> 8 == 0x00 && flags(psw) == CY);
+	psw = pswAfter("STC\nMVI A, 02H\nRAR");
+	CHECK(psw >> 8 == 0x81 && flags(psw) == 0);
+	psw = pswAfter("STC\nCMC\nMVI A, 55H\nCMA");
+	CHECK(psw >> 8 == 0xAA && flags(psw) == 0);
+	// DAA corrects both nibbles of a BCD sum
+	psw = pswAfter("MVI A, 09H\nADI 08H\nDAA");
+	CHECK(psw >> 8 == 0x17 && flags(psw) == P);
+	psw = pswAfter("MVI A, 99H\nADI 01H\nDAA");
+	CHECK(psw >> 8 == 0x00 && flags(psw) == (Z | AC | P | CY));
+}
+
+// Breakpoints stop before the instruction, watchpoints after the access that hit them
+static void testBreakpointsAndWatchpoints(){
+	CPU cpu;
+	cpu.reset();
+	CHECK(assemble("MVI A, 42H\nSTA 3000H\nLDA 3001H\nOUT 10H\nstop: HLT\n", cpu).ok);
+	cpu.addBreakpoint(0x0002);
+	RunResult result = cpu.run_for(1000);
+	CHECK(result.reason == StopReason::BREAKPOINT && result.address == 0x0002 && cpu.reg_PC == 0x0002);
+	CHECK(cpu.memory[0x3000] == 0x00);
+	cpu.removeBreakpoint(0x0002);
+
+	cpu.addWatchpoint(0x3000, 0x3001, WATCH_WRITE);
+	result = cpu.run_for(1000);
+	CHECK(result.reason == StopReason::WATCHPOINT && result.address == 0x3000 && result.access == WATCH_WRITE);
+	CHECK(cpu.memory[0x3000] == 0x42 && cpu.reg_PC == 0x0005);
+
+	// A write watch does not see reads
+	cpu.removeWatchpoint(0x3000, 0x3001, WATCH_WRITE);
+	cpu.addWatchpoint(0x3001, 0x3001, WATCH_READ);
+	result = cpu.run_for(1000);
+	CHECK(result.reason == StopReason::WATCHPOINT && result.address == 0x3001 && result.access == WATCH_READ);
+	CHECK(cpu.reg_PC == 0x0008);
+
+	cpu.removeWatchpoint(0x3001, 0x3001, WATCH_READ);
+	cpu.addPortWatchpoint(0x10, WATCH_WRITE);
+	result = cpu.run_for(1000);
+	CHECK(result.reason == StopReason::WATCHPOINT && result.address == 0x10 && result.access == WATCH_WRITE);
+	CHECK(cpu.ports[0x10] == 0x00 && cpu.reg_PC == 0x000A);
+
+	cpu.removeWatchpoint(0x10, 0x10, WATCH_WRITE, true);
+	CHECK(!cpu.debugActive());
+	CHECK(cpu.run_for(1000).reason == StopReason::HALTED && cpu.reg_PC == 0x000B);
+}
+
+// Refused accesses stop the CPU at the faulting instruction until clearFault()
+static void testProtectionFaults(){
+	CPU cpu;
+	cpu.reset();
+	CHECK(assemble("MVI A, 42H\nSTA 3000H\nLDA 3100H\nJMP 4000H\nORG 4000H\nHLT\n", cpu).ok);
+	cpu.memory[0x3100] = 0x99;
+	cpu.protect(0x3000, 0x100, PERM_READ);
+	cpu.protect(0x3100, 0x100, PERM_WRITE);
+	cpu.protect(0x4000, 0x100, PERM_READ | PERM_WRITE);
+
+	RunResult result = cpu.run_for(1000);
+	CHECK(result.reason == StopReason::PROTECTION_FAULT && cpu.faulted && cpu.HALT);
+	CHECK(cpu.fault.address == 0x3000 && cpu.fault.access == PERM_WRITE && cpu.fault.pc == 0x0002);
+	CHECK(cpu.memory[0x3000] == 0x00);
+	// Still stopped without clearFault()
+	CHECK(cpu.run_for(1000).cycles == 0);
+
+	cpu.clearFault();
+	result = cpu.run_for(1000);
+	CHECK(result.reason == StopReason::PROTECTION_FAULT);
+	CHECK(cpu.fault.address == 0x3100 && cpu.fault.access == PERM_READ && cpu.fault.pc == 0x0005);
+	CHECK(cpu.reg_A == 0xFF);
+
+	cpu.clearFault();
+	result = cpu.run_for(1000);
+	CHECK(result.reason == StopReason::PROTECTION_FAULT);
+	CHECK(cpu.fault.address == 0x4000 && cpu.fault.access == PERM_EXEC && cpu.reg_PC == 0x4000);
+
+	cpu.protect(0x4000, 0x100, PERM_ALL);
+	cpu.clearFault();
+	CHECK(cpu.run_for(1000).reason == StopReason::HALTED && cpu.reg_PC == 0x4001);
+}
+
+// resetToBaseline() restores the pages written since the baseline and only those
+static void testDirtyPageReset(){
+	CPU cpu;
+	cpu.reset();
+	CHECK(assemble("LXI SP, 0F000H\nLXI H, 3000H\nMVI M, 77H\nPUSH H\nHLT\n", cpu).ok);
+	cpu.memory[0x5000] = 0x11;
+	cpu.setBaseline();
+	CHECK(cpu.run_for(1000).reason == StopReason::HALTED);
+	CHECK(cpu.memory[0x3000] == 0x77 && cpu.memory[0xEFFF] == 0x30);
+	auto dirty = [&cpu](int page){
+		return (cpu.dirtyPages[page >> 6] >> (page & 63)) & 1;
+	};
+	CHECK(dirty(0x30) && dirty(0xEF) && !dirty(0x00) && !dirty(0x50));
+
+	// A host write has to be reported to be reset
+	cpu.memory[0x5000] = 0x22;
+	cpu.markDirty(0x5000, 1);
+	CHECK(dirty(0x50));
+
+	cpu.resetToBaseline();
+	CHECK(cpu.memory[0x3000] == 0x00 && cpu.memory[0xEFFF] == 0x00 && cpu.memory[0x5000] == 0x11);
+	CHECK(cpu.memory[0x0000] == LXI_SP_D16 && cpu.reg_PC == 0x0000 && cpu.reg_SP == 0x0000 && !cpu.HALT);
+	for(uint64_t word : cpu.dirtyPages)
+		CHECK(word == 0);
+	// and runs the same again
+	CHECK(cpu.run_for(1000).reason == StopReason::HALTED && cpu.memory[0x3000] == 0x77);
+}
+
+// Every kind of data access inside a region goes to its handlers, RAM pages and unmapped
+// regions stay plain memory
+static void testMmio(){
+	CPU cpu;
+	cpu.reset();
+	CHECK(assemble(
+		"LXI SP, 80F0H\nMVI A, 11H\nSTA 8010H\nLDA 8020H\nMOV B, A\n"
+		"LXI H, 8030H\nMVI M, 22H\nMOV C, M\nLXI H, 3344H\nSHLD 8040H\nLHLD 8050H\n"
+		"PUSH B\nPOP D\nSTA 3000H\nLDA 3000H\nHLT\n", cpu).ok);
+	std::vector<uint16_t> reads;
+	std::vector<std::pair<uint16_t, uint8_t>> writes;
+	cpu.mapMmio(0x8000, 0x80FF, [&reads](uint16_t address){
+		reads.push_back(address);
+		return static_cast<uint8_t>(address ^ 0x5A);
+	}, [&writes](uint16_t address, uint8_t value){
+		writes.push_back({address, value});
+	});
+
+	CHECK(cpu.run_for(10000).reason == StopReason::HALTED);
+	std::vector<std::pair<uint16_t, uint8_t>> expectedWrites = {
+		{0x8010, 0x11}, {0x8030, 0x22}, {0x8040, 0x44}, {0x8041, 0x33}, {0x80EF, 0x7A}, {0x80EE, 0x6A}
+	};
+	CHECK(writes == expectedWrites);
+	CHECK((reads == std::vector<uint16_t>{0x8020, 0x8030, 0x8050, 0x8051, 0x80EE, 0x80EF}));
+	CHECK(cpu.reg_B == 0x7A && cpu.reg_C == 0x6A && cpu.getRegister(HL) == 0x0B0A && cpu.getRegister(DE) == 0xB5B4);
+	// The handlers took the writes, memory behind the region is untouched, RAM is RAM
+	CHECK(cpu.memory[0x8010] == 0x00 && cpu.memory[0x80EF] == 0x00);
+	CHECK(cpu.memory[0x3000] == 0x7A && cpu.reg_A == 0x7A);
+
+	cpu.unmapMmio(0x8000);
+	cpu.resetRegisters();
+	reads.clear();
+	writes.clear();
+	CHECK(cpu.run_for(10000).reason == StopReason::HALTED);
+	CHECK(reads.empty() && writes.empty());
+	CHECK(cpu.memory[0x8010] == 0x11 && cpu.memory[0x8030] == 0x22 && cpu.memory[0x8040] == 0x44 && cpu.memory[0x8041] == 0x33);
+	CHECK(cpu.reg_B == 0x00 && cpu.reg_C == 0x22 && cpu.getRegister(HL) == 0x0000 && cpu.getRegister(DE) == 0x0022);
+}
+
+// Windows switched by OUT to their select port and by selectBank(), banks past the end of
+// the store are refused
+static void testBankSwitching(){
+	CPU cpu;
+	cpu.reset();
+	BankStore store;
+	CHECK(store.allocate(4 * 0x1000));
+	for(int bank = 0; bank < 4; bank++)
+		store.data()[bank * 0x1000] = static_cast<uint8_t>(0x10 + bank);
+
+	BankStore small;
+	CHECK(small.allocate(0x800));
+	CHECK(cpu.addBankWindow(0x8080, 0x100, store) == -1);
+	CHECK(cpu.addBankWindow(0x8000, 0, store) == -1);
+	CHECK(cpu.addBankWindow(0x8000, 0x180, store) == -1);
+	CHECK(cpu.addBankWindow(0xFF00, 0x200, store) == -1);
+	CHECK(cpu.addBankWindow(0x8000, 0x1000, small) == -1);
+	CHECK(cpu.bankWindows.empty());
+	CHECK(cpu.addBankWindow(0x8000, 0x1000, store, 0x40) == 0);
+
+	CHECK(assemble(
+		"LDA 8000H\nMOV B, A\nMVI A, 2\nOUT 40H\nLDA 8000H\nMOV C, A\n"
+		"MVI A, 4\nOUT 40H\nLDA 8000H\nMOV D, A\nMVI A, 55H\nSTA 8001H\nHLT\n", cpu).ok);
+	CHECK(cpu.run_for(10000).reason == StopReason::HALTED);
+	CHECK(cpu.reg_B == 0x10 && cpu.reg_C == 0x12);
+	// Bank 4 does not exist, bank 2 stays selected and takes the store
+	CHECK(cpu.reg_D == 0x12 && cpu.bankWindows[0].bank == 2);
+	CHECK(store.data()[2 * 0x1000 + 1] == 0x55 && cpu.memory[0x8001] == 0x00);
+
+	CHECK(!cpu.selectBank(0, 4) && cpu.bankWindows[0].bank == 2);
+	CHECK(cpu.selectBank(0, 3) && cpu.peekByte(0x8000) == 0x13 && cpu.peekByte(0x8001) == 0x00);
+	CHECK(cpu.selectBank(0, 2) && cpu.peekByte(0x8001) == 0x55);
+}
+
+// The undocumented opcodes are 1-byte NOPs of 4 T-states, like the disassembler lists them
+static void testUndocumentedOpcodes(){
+	const uint8_t opcodes[] = {0x08, 0x10, 0x18, 0x28, 0x38, 0xCB, 0xD9, 0xDD, 0xED, 0xFD};
+	for(uint8_t opcode : opcodes){
+		CPU cpu;
+		cpu.reset();
+		uint8_t program[] = {opcode, 0x00, 0x00, HLT};
+		loadProgramFromBytes(program, sizeof(program), cpu.memory, sizeof(cpu.memory), 0x0000);
+		CHECK(opcodeTable[opcode].flow == FLOW_INVALID && opcodeTable[opcode].length == 1);
+		cpu.step();
+		CHECK(cpu.reg_PC == 0x0001 && cpu.cycles == 4 && cpu.reg_SP == 0x0000);
+	}
+}
+
+// RST 1 counts in B, the main program reads two ports and idles in EI; HLT
+static const char* REPLAY_PROGRAM =
+	"JMP start\nORG 8\nINR B\nEI\nRET\n"
+	"start: LXI SP, 0F000H\nIN 10H\nMOV C, A\nIN 11H\nMOV D, A\n"
+	"idle: EI\nHLT\nJMP idle\n";
+
+// A recorded run replays without its devices, also through interrupts that woke it from HLT
+// after the host moved its clock on, and a program that asks for other input diverges
+static void testRecordReplay(){
+	char path[] = "/tmp/cpu_test_replay.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+
+	CPU recorded;
+	recorded.reset();
+	InputLog recording;
+	CHECK(recording.startRecording(path));
+	recorded.inputLog = &recording;
+	CHECK(assemble(REPLAY_PROGRAM, recorded).ok);
+	recorded.ports[0x10] = 0x42;
+	recorded.ports[0x11] = 0x99;
+	for(int i = 0; i < 3; i++){
+		CHECK(recorded.run_for(1000).reason == StopReason::HALTED);
+		// The host idles the halted CPU, as Board and DeviceScheduler do, then interrupts it
+		recorded.cycles += 500 + i * 100;
+		recorded.interrupt(1);
+	}
+	CHECK(recorded.run_for(1000).reason == StopReason::HALTED);
+	CHECK(recorded.reg_B == 3 && recorded.reg_C == 0x42 && recorded.reg_D == 0x99);
+	recording.close();
+
+	CPU replayed;
+	replayed.reset();
+	InputLog replay;
+	CHECK(replay.startReplay(path));
+	replayed.inputLog = &replay;
+	CHECK(assemble(REPLAY_PROGRAM, replayed).ok);
+	for(int i = 0; i < 10; i++)
+		replayed.run_for(1000);
+	CHECK(replayed.reg_B == 3 && replayed.reg_C == 0x42 && replayed.reg_D == 0x99);
+	CHECK(replayed.cycles == recorded.cycles && replayed.instructions == recorded.instructions);
+	CHECK(replayed.HALT && replayed.reg_PC == recorded.reg_PC && !replay.diverged());
+	CHECK(replay.nextEventCycle() == UINT64_MAX);
+
+	// Reading another port than the one logged is a divergence
+	CPU other;
+	other.reset();
+	InputLog divergent;
+	CHECK(divergent.startReplay(path));
+	other.inputLog = &divergent;
+	std::string source = REPLAY_PROGRAM;
+	source.replace(source.find("IN 11H"), 6, "IN 12H");
+	CHECK(assemble(source, other).ok);
+	other.run_for(1000);
+	CHECK(divergent.diverged());
+	unlink(path);
+}
+
+// Totals published across a reset keep counting up and reach a reader in another mapping
+static void testPerfCounters(){
+	std::string name = "/cpu_test_perf_" + std::to_string(getpid());
+	PerfExporter exporter;
+	CHECK(exporter.open(name));
+	PerfReader reader;
+	CHECK(reader.open(name));
+
+	CPU cpu;
+	cpu.reset();
+	// Two IN and an OUT per pass
+	CHECK(assemble("MVI B, 10\nloop: IN 1\nIN 2\nOUT 3\nDCR B\nJNZ loop\nHLT\n", cpu).ok);
+	CHECK(cpu.run_for(100000).reason == StopReason::HALTED);
+	exporter.publish(cpu);
+	PerfSnapshot first;
+	CHECK(reader.read(first));
+	CHECK(first.pid == static_cast<uint32_t>(getpid()));
+	CHECK(first.instructions == cpu.instructions && first.cycles == cpu.cycles && first.portAccesses == 30);
+	uint64_t firstCycles = cpu.cycles;
+
+	cpu.resetRegisters();
+	CHECK(cpu.cycles == 0);
+	CHECK(cpu.run_for(100000).reason == StopReason::HALTED);
+	exporter.publish(cpu);
+	PerfSnapshot second;
+	CHECK(reader.read(second));
+	CHECK(second.pid == first.pid);
+	CHECK(second.instructions == 2 * first.instructions && second.cycles == firstCycles + cpu.cycles);
+	CHECK(second.cycles == 2 * first.cycles && second.portAccesses == 60);
+	CHECK(second.wallNanos >= first.wallNanos && second.hostCpuNanos >= first.hostCpuNanos);
+	exporter.close();
+	PerfReader gone;
+	CHECK(!gone.open(name));
+}
+
+// Everything logger() writes at LOG_INFO while body runs, in format. main() runs at LOG_ERROR.
+template<typename Body>
+static std::string captureLog(LogFormat format, Body body){
+	FILE* file = tmpfile();
+	Logger& log = logger();
+	log.setOutput(file);
+	log.setFormat(format);
+	log.setLevel(LOG_INFO);
+	body();
+	log.flush();
+	log.setOutput(stdout);
+	log.setFormat(LOG_TEXT);
+	log.setLevel(LOG_ERROR);
+	std::string text;
+	rewind(file);
+	for(int c = fgetc(file); c != EOF; c = fgetc(file))
+		text += static_cast<char>(c);
+	fclose(file);
+	return text;
+}
+
+// The dump formats every byte like the scalar code, collapses repeated lines and pads a
+// short last line
+static void testMemoryDump(){
+	for(int first = 0; first < 0x100; first += 16){
+		uint8_t bytes[16];
+		for(int i = 0; i < 16; i++)
+			bytes[i] = static_cast<uint8_t>(first + i);
+		char hex[32], ascii[16];
+		formatDumpChunk(bytes, hex, ascii);
+		for(int i = 0; i < 16; i++){
+			char expected[2];
+			Logger::writeHex(expected, bytes[i], 2);
+			CHECK(hex[i * 2] == expected[0] && hex[i * 2 + 1] == expected[1]);
+			CHECK(ascii[i] == ((bytes[i] >= 0x20 && bytes[i] < 0x7F) ? static_cast<char>(bytes[i]) : '.'));
+		}
+	}
+
+	uint8_t memory[16 * 5 + 5];
+	for(int i = 0; i < 16; i++)
+		memory[i] = static_cast<uint8_t>('A' + i);
+	memset(memory + 16, 0, 48);
+	for(int i = 0; i < 16; i++)
+		memory[64 + i] = static_cast<uint8_t>(0x7C + i);
+	memcpy(memory + 80, "\x01Hi!\xFF", 5);
+	auto dump = [&memory]{
+		printAddressArray(memory, sizeof(memory), 0x2000);
+	};
+	CHECK(captureLog(LOG_TEXT, dump) ==
+		"002000  41 42 43 44 45 46 47 48 49 4A 4B 4C 4D 4E 4F 50  ABCDEFGHIJKLMNOP\n"
+		"002010  00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00  ................\n"
+		"*\n"
+		"002040  7C 7D 7E 7F 80 81 82 83 84 85 86 87 88 89 8A 8B  |}~.............\n"
+		"002050  01 48 69 21 FF                                   .Hi!.\n");
+	CHECK(captureLog(LOG_JSON, dump) ==
+		"{\"type\":\"memory\",\"address\":8192,\"bytes\":\"4142434445464748494A4B4C4D4E4F50\"}\n"
+		"{\"type\":\"memory\",\"address\":8208,\"bytes\":\"00000000000000000000000000000000\"}\n"
+		"{\"type\":\"repeat\",\"address\":8224,\"lines\":2}\n"
+		"{\"type\":\"memory\",\"address\":8256,\"bytes\":\"7C7D7E7F808182838485868788898A8B\"}\n"
+		"{\"type\":\"memory\",\"address\":8272,\"bytes\":\"01486921FF\"}\n");
+	// A short last line equal to the start of the previous one is not a repeat
+	uint8_t zeros[20] = {0};
+	CHECK(captureLog(LOG_JSON, [&zeros]{ printAddressArray(zeros, sizeof(zeros)); }) ==
+		"{\"type\":\"memory\",\"address\":0,\"bytes\":\"00000000000000000000000000000000\"}\n"
+		"{\"type\":\"memory\",\"address\":16,\"bytes\":\"00000000\"}\n");
+}
+
+// A zero slice still makes progress and every slice reaches onSlice
+static void testRunLimitsZeroSlice(){
+	CPU cpu;
+	cpu.reset();
+	uint8_t loop[] = {NOP, JMP_A16, 0x00, 0x00};
+	loadProgramFromBytes(loop, sizeof(loop), cpu.memory, sizeof(cpu.memory), 0x0000);
+	RunLimits limits;
+	limits.maxInstructions = 100;
+	limits.sliceCycles = 0;
+	int slices = 0;
+	limits.onSlice = [&slices](CPU&){
+		slices++;
+	};
+	RunResult result = cpu.run_limited(limits);
+	CHECK(result.reason == StopReason::INSTRUCTION_BUDGET);
+	CHECK(cpu.instructions >= 100 && slices > 0);
+}
+
+int main(){
+	logger().setLevel(LOG_ERROR);
+	testBreakpointsInSlices();
+	testXthl();
+	testCodeMapTopOfMemory();
+	testAssembleOverRunCode();
+	testLoggerThreads();
+	testRunLimitsZeroSlice();
+	testAluFlags();
+	testBreakpointsAndWatchpoints();
+	testProtectionFaults();
+	testDirtyPageReset();
+	testMemoryDump();
+	testMmio();
+	testBankSwitching();
+	testUndocumentedOpcodes();
+	testRecordReplay();
+	testPerfCounters();
+	return checkResult("cpu_test");
+}
@@ -0,0 +1,133 @@
+// JobServer over its Unix socket, run by ctest
+
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "daemon.h"
+
+static const char* SOCKET_PATH = "daemon_test.sock";
+
+static int connectClient(){
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, SOCKET_PATH, sizeof(address.sun_path) - 1);
+	if(connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void sendAll(int fd, const std::string& text){
+	size_t sent = 0;
+	while(sent < text.size()){
+		ssize_t count = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+		if(count <= 0)
+			return;
+		sent += count;
+	}
+}
+
+// Everything the server sends until it closes the connection
+static std::string readToEnd(int fd){
+	std::string text;
+	char buffer[4096];
+	ssize_t count;
+	while((count = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+		text.append(buffer, count);
+	return text;
+}
+
+// Reads until text contains what
+static std::string readUntil(int fd, const std::string& what){
+	std::string text;
+	char buffer[4096];
+	ssize_t count;
+	while(text.find(what) == std::string::npos && (count = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+		text.append(buffer, count);
+	return text;
+}
+
+struct Server {
+	JobServer server{1};
+	std::thread thread;
+	Server(){
+		CHECK(server.listenUnix(SOCKET_PATH));
+		thread = std::thread([this](){ server.run(); });
+	}
+	~Server(){
+		server.stop();
+		thread.join();
+	}
+};
+
+static void testJob(){
+	Server server;
+	int fd = connectClient();
+	CHECK(fd >= 0);
+	// MVI A,5; HLT
+	sendAll(fd, "JOB one\nLOAD 0 3E0576\nOUTPUT REGS\nRUN\n");
+	std::string reply = readUntil(fd, "DONE one\n");
+	CHECK(reply.find("RESULT one halted cycles=14 instructions=2 pc=0003") != std::string::npos);
+	CHECK(reply.find("REGS one A=05") != std::string::npos);
+	close(fd);
+}
+
+// A long job id does not cut the reply lines short
+static void testLongJobId(){
+	Server server;
+	int fd = connectClient();
+	CHECK(fd >= 0);
+	std::string id(300, 'j');
+	sendAll(fd, "JOB " + id + "\nLOAD 0 3E0576\nOUTPUT REGS\nOUTPUT MEM 0 3\nRUN\n");
+	std::string reply = readUntil(fd, "DONE " + id + "\n");
+	CHECK(reply == "RESULT " + id + " halted cycles=14 instructions=2 pc=0003\n"
+	               "REGS " + id + " A=05 B=00 C=00 D=00 E=00 H=00 L=00 SP=0000 FLAGS=00\n"
+	               "MEM " + id + " 0000 3E0576\n"
+	               "DONE " + id + "\n");
+	close(fd);
+}
+
+// A client that never ends its line is dropped instead of growing the buffer
+static void testLineTooLong(){
+	Server server;
+	int fd = connectClient();
+	sendAll(fd, "JOB big\nLOAD 0 " + std::string(JobServer::MAX_LINE + 4096, '0'));
+	std::string reply = readToEnd(fd);
+	CHECK(reply == "ERROR - line too long\n");
+	close(fd);
+}
+
+// stop() lets the running job finish, rejects the queued ones and closes idle connections
+static void testStop(){
+	Server server;
+	int idle = connectClient();
+	int fd = connectClient();
+	// JMP 0 until the deadline, then two jobs that wait behind it on the only worker
+	sendAll(fd, "JOB loop\nLOAD 0 C30000\nBUDGET 100000000000\nTIMEOUT 300\nRUN\n"
+				"JOB second\nLOAD 0 76\nRUN\nJOB third\nLOAD 0 76\nRUN\n");
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	server.server.stop();
+	std::string reply = readToEnd(fd);
+	CHECK(reply.find("ERROR second server stopping\n") != std::string::npos);
+	CHECK(reply.find("ERROR third server stopping\n") != std::string::npos);
+	CHECK(reply.find("RESULT loop deadline") != std::string::npos && reply.find("DONE loop\n") != std::string::npos);
+	CHECK(readToEnd(idle).empty());
+	close(fd);
+	close(idle);
+}
+
+int main(){
+	logger().setLevel(LOG_ERROR);
+	testJob();
+	testLongJobId();
+	testLineTooLong();
+	testStop();
+	unlink(SOCKET_PATH);
+	return checkResult("daemon_test");
+}
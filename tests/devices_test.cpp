@@ -0,0 +1,82 @@
+// Coroutine devices under DeviceScheduler, run by ctest (needs C++20)
+
+#include <string>
+#include "check.h"
+#include "assembler.h"
+#include "devices.h"
+
+// Collects every byte written to its port
+static Device uart(DeviceScheduler& bus, uint8_t port, std::string& received){
+	while(true)
+		received += static_cast<char>(co_await bus.output(port));
+}
+
+// Counts up in its port latch every period T-states, noting the cycle of each tick
+static Device timer(DeviceScheduler& bus, uint8_t port, uint64_t period, int nTicks, std::vector<uint64_t>& ticks){
+	for(int i = 0; i < nTicks; i++){
+		co_await bus.delay(period);
+		ticks.push_back(bus.cpu.cycles);
+		bus.cpu.ports[port]++;
+	}
+}
+
+// Answers each read of its port with the next byte of text, then with 0
+static Device keyboard(DeviceScheduler& bus, uint8_t port, const char* text){
+	for(const char* c = text; ; c++){
+		co_await bus.input(port);
+		bus.cpu.ports[port] = static_cast<uint8_t>(*c);
+		if(!*c)
+			break;
+	}
+}
+
+// Echoes the keyboard to the UART until a 0 byte, then halts
+static void testPortAwaiters(){
+	CPU cpu;
+	cpu.reset();
+	CHECK(assemble("loop: IN 30H\nORA A\nJZ done\nOUT 10H\nJMP loop\ndone: HLT\n", cpu).ok);
+	std::string received;
+	DeviceScheduler bus(cpu);
+	bus.add(uart(bus, 0x10, received));
+	bus.add(keyboard(bus, 0x30, "hello"));
+	RunResult result = bus.run(100000);
+	CHECK(result.reason == StopReason::HALTED);
+	CHECK(received == "hello");
+}
+
+// Wake-ups land on the first instruction boundary at or after their cycle, also while halted
+static void testDelay(){
+	CPU cpu;
+	cpu.reset();
+	// Spin until the timer counted to 3, then halt
+	CHECK(assemble("loop: IN 20H\nCPI 3\nJC loop\nHLT\n", cpu).ok);
+	std::vector<uint64_t> ticks;
+	DeviceScheduler bus(cpu);
+	bus.add(timer(bus, 0x20, 1000, 3, ticks));
+	RunResult result = bus.run(100000);
+	CHECK(result.reason == StopReason::HALTED);
+	CHECK(ticks.size() == 3);
+	// delay counts from the resume, which comes at most one instruction late
+	for(size_t i = 0; i < ticks.size(); i++){
+		uint64_t since = i ? ticks[i - 1] : 0;
+		CHECK(ticks[i] - since >= 1000 && ticks[i] - since < 1000 + 18);
+	}
+
+	// A halted CPU idles up to the next wake-up instead of stopping the run
+	CPU idle;
+	idle.reset();
+	CHECK(assemble("HLT\n", idle).ok);
+	std::vector<uint64_t> idleTicks;
+	DeviceScheduler idleBus(idle);
+	idleBus.add(timer(idleBus, 0x20, 250, 8, idleTicks));
+	result = idleBus.run(1000);
+	CHECK(result.reason == StopReason::CYCLE_BUDGET && result.cycles >= 1000);
+	CHECK(idleTicks.size() == 4 && idleTicks[0] == 250 && idleTicks[3] == 1000);
+}
+
+int main(){
+	logger().setLevel(LOG_ERROR);
+	testPortAwaiters();
+	testDelay();
+	return checkResult("devices_test");
+}
@@ -0,0 +1,150 @@
+// GdbStub driven over its Unix socket the way gdb would, run by ctest
+
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "check.h"
+#include "gdbstub.h"
+
+// Minimal gdb side: sends a packet, skips the ack and returns the reply payload
+class Client {
+public:
+	explicit Client(const std::string& path){
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+		connected = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+	}
+	~Client(){
+		close(fd);
+	}
+
+	std::string request(const std::string& payload){
+		post(payload);
+		return reply();
+	}
+
+	// For packets without a reply, like k
+	void post(const std::string& payload){
+		uint8_t sum = 0;
+		for(char c : payload)
+			sum += static_cast<uint8_t>(c);
+		char checksum[4];
+		snprintf(checksum, sizeof(checksum), "#%02x", sum);
+		std::string packet = "$" + payload + checksum;
+		send(fd, packet.data(), packet.size(), MSG_NOSIGNAL);
+	}
+
+	std::string reply(){
+		std::string text;
+		char c;
+		while(recv(fd, &c, 1, 0) == 1){
+			if(c == '+' && text.empty())
+				continue;
+			text += c;
+			size_t hash = text.find('#');
+			if(hash != std::string::npos && text.size() == hash + 3)
+				return text.substr(1, hash - 1);
+		}
+		return "<closed>";
+	}
+
+	bool connected = false;
+
+private:
+	int fd = -1;
+};
+
+static const char* SOCKET_PATH = "gdbstub_test.sock";
+
+// Runs program under the stub with tiny slices, session() plays gdb
+template<typename Session>
+static void debugSession(const std::vector<uint8_t>& program, Session session){
+	CPU cpu;
+	cpu.reset();
+	loadProgramFromBytes(program.data(), program.size(), cpu.memory, sizeof(cpu.memory), 0x0000);
+	GdbStub stub(cpu);
+	CHECK(stub.listenUnix(SOCKET_PATH));
+	std::thread target([&]{
+		stub.waitForAttach();
+		stub.run(8);
+	});
+	{
+		Client gdb(SOCKET_PATH);
+		CHECK(gdb.connected);
+		session(gdb, cpu);
+	}
+	target.join();
+	stub.stop();
+}
+
+// The first slice of 8 T-states ends right on the breakpoint at 0002
+static void testContinueToSliceBoundary(){
+	debugSession({NOP, NOP, NOP, JMP_A16, 0x00, 0x00}, [](Client& gdb, CPU&){
+		CHECK(gdb.request("?") == "S05");
+		CHECK(gdb.request("Z0,2,1") == "OK");
+		for(int pass = 0; pass < 3; pass++){
+			CHECK(gdb.request("c") == "S05");
+			CHECK(gdb.request("p5") == "0200");
+		} 
+		CHECK(gdb.request("z0,2,1") == "OK");
+		gdb.post("k");
+	});
+}
+
+static void testMalformedPackets(){
+	debugSession({HLT}, [](Client& gdb, CPU& cpu){
+		CHECK(gdb.request("?") == "S05");
+		CHECK(gdb.request("m1234") == "E01");
+		CHECK(gdb.request("M1234") == "E01");
+		CHECK(gdb.request("Z0") == "E01");
+		CHECK(gdb.request("z0,10") == "E01");
+		CHECK(gdb.request("m0,1") == "76");
+		CHECK(gdb.request("Z0,10000,1") == "E01");
+		CHECK(gdb.request("Z2,ffff,2") == "E01");
+		CHECK(gdb.request("z3,10000,1") == "E01");
+		CHECK(cpu.breakpointCount == 0 && cpu.watchpoints.empty());
+		gdb.post("k");
+	});
+}
+
+// watch and rwatch on the same byte are removed one at a time
+static void testWatchpointTypes(){
+	// LDA 2000H; STA 2000H; HLT
+	debugSession({LDA_A16, 0x00, 0x20, STA_A16, 0x00, 0x20, HLT}, [](Client& gdb, CPU&){
+		CHECK(gdb.request("?") == "S05");
+		CHECK(gdb.request("Z2,2000,1") == "OK");
+		CHECK(gdb.request("Z3,2000,1") == "OK");
+		CHECK(gdb.request("z2,2000,1") == "OK");
+		CHECK(gdb.request("c") == "T05rwatch:2000;");
+		CHECK(gdb.request("c") == "W00");
+	});
+}
+
+// A fault is a stop, not an exit: gdb can read the state and continuing faults again
+static void testFaultIsStop(){
+	// MVI A,1; STA 2000H
+	debugSession({MVI_A_D8, 0x01, STA_A16, 0x00, 0x20}, [](Client& gdb, CPU& cpu){
+		CHECK(gdb.request("?") == "S05");
+		cpu.protect(0x2000, 0x100, PERM_READ);
+		CHECK(gdb.request("c") == "S0b");
+		CHECK(gdb.request("p0").substr(2) == "01");
+		CHECK(gdb.request("c") == "S0b");
+		CHECK(gdb.request("s") == "S0b");
+		gdb.post("k");
+	});
+}
+
+int main(){
+	logger().setLevel(LOG_ERROR);
+	testContinueToSliceBoundary();
+	testMalformedPackets();
+	testWatchpointTypes();
+	testFaultIsStop();
+	unlink(SOCKET_PATH);
+	return checkResult("gdbstub_test");
+}
@@ -0,0 +1,177 @@
+// Assembler, disassembler and the image and translation caches, run by ctest from the source
+// directory (prog.asm, prog.bin)
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <cstdlib>
+#include "check.h"
+#include "cpu.h"
+#include "disasm.h"
+#include "assembler.h"
+#include "imagecache.h"
+#include "transcache.h"
+
+static std::vector<uint8_t> readFile(const std::string& path){
+	std::ifstream file(path, std::ios::binary);
+	return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// prog.bin is the assembled prog.asm, less the data block main.cpp adds itself
+static void testAssembleProgram(){
+	std::vector<uint8_t> binary = readFile("prog.bin");
+	std::ifstream file("prog.asm");
+	std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	CHECK(!binary.empty() && !source.empty());
+
+	std::vector<uint8_t> memory(0x10000, 0);
+	AssemblyResult result = assemble(source, memory.data(), memory.size());
+	CHECK(result.ok && result.errors.empty());
+	CHECK(result.segments.size() == 2);
+	CHECK(result.segments[0].first == 0x0000 && result.segments[0].second == binary.size());
+	CHECK(std::equal(binary.begin(), binary.end(), memory.begin()));
+	CHECK(result.labels["inner"] == 0x000A && result.labels["skip"] == 0x0015);
+	CHECK(memory[0x3000] == 0x05 && memory[0x3004] == 0x03);
+
+	// Errors carry their line
+	result = assemble("NOP\nMOV A\n", memory.data(), memory.size());
+	CHECK(!result.ok && !result.errors.empty() && result.errors[0].rfind("line 2", 0) == 0);
+	result = assemble("NOP\nNOP\nJMP nowhere\n", memory.data(), memory.size());
+	CHECK(!result.ok && !result.errors.empty() && result.errors[0].rfind("line 3", 0) == 0);
+
+	// Operands that do not fit are errors, not truncated
+	const char* outOfRange[] = {"MVI A, 256", "MVI A, -129", "ADI 1FFH", "DB 300", "JMP 10000H", "LXI H, -8001H",
+	                            "DW 70000", "ORG 10000H", "RST 9", "MVI A, big\nbig EQU 100H"};
+	for(const char* source : outOfRange){
+		result = assemble(source, memory.data(), memory.size());
+		CHECK(!result.ok && !result.errors.empty());
+	}
+	result = assemble("MVI A, -128\nMVI B, 255\nLXI H, -1\nDW 0FFFFH\nDB -1\n", memory.data(), memory.size());
+	CHECK(result.ok && memory[1] == 0x80 && memory[3] == 0xFF && memory[5] == 0xFF && memory[6] == 0xFF);
+}
+
+// Every opcode disassembles to text that assembles back to the same bytes
+static void testDisassemblerRoundTrip(){
+	int checked = 0;
+	for(int opcode = 0; opcode < 0x100; opcode++){
+		const OpcodeInfo& info = opcodeTable[opcode];
+		if(info.flow == FLOW_INVALID)
+			continue;
+		uint8_t bytes[3] = {static_cast<uint8_t>(opcode), 0x34, 0x12};
+		std::string text = disassemble(bytes, sizeof(bytes), 0);
+		uint8_t assembled[3] = {0};
+		AssemblyResult result = assemble(text, assembled, sizeof(assembled));
+		bool same = result.ok && result.segments.size() == 1 && result.segments[0].second == info.length
+		            && std::equal(bytes, bytes + info.length, assembled);
+		if(!same)
+			fprintf(stderr, "0x%02X: \"%s\" does not assemble back\n", opcode, text.c_str());
+		CHECK(same);
+		checked++;
+	}
+	CHECK(checked == 0x100 - 10);
+}
+
+// Same bytes at the same address hit, anything else misses, and a directory carries the
+// entries over to another cache
+static void testImageCache(const std::string& directory){
+	std::vector<uint8_t> program = readFile("prog.bin");
+	ImageCache cache;
+	ImageRef first = cache.get(program.data(), program.size(), 0x0000);
+	ImageRef again = cache.get(program.data(), program.size(), 0x0000);
+	CHECK(first && first == again);
+	CHECK(cache.hits == 1 && cache.misses == 1);
+	CHECK(first->codeMap.blocks.count(0x0000) && first->codeMap.blocks.count(0x000A) && first->codeMap.blocks.count(0x0015));
+
+	// Another load address or one changed byte is another image
+	CHECK(cache.get(program.data(), program.size(), 0x0100) != first);
+	std::vector<uint8_t> patched = program;
+	patched[9] = 0x03;
+	CHECK(cache.get(patched.data(), patched.size(), 0x0000) != first);
+	CHECK(cache.hits == 1 && cache.misses == 3);
+
+	// An attached image runs like a loaded one
+	CPU cpu;
+	cpu.reset();
+	CHECK(attachImage(cpu, *first) == program.size());
+	CHECK(assemble("ORG 3000H\nDB 05H, 02H, 04H, 01H, 03H\n", cpu).ok);
+	CHECK(cpu.run_for(100000).reason == StopReason::HALTED);
+	for(int i = 0; i < 5; i++)
+		CHECK(cpu.memory[0x3000 + i] == i + 1);
+
+	// Written to disk by one cache, read back by the next
+	ImageCache writer;
+	writer.setDirectory(directory);
+	ImageRef written = writer.get(program.data(), program.size(), 0x0000);
+	std::string path = directory + "/" + Logger::hexString(written->hash >> 32, 8) + Logger::hexString(written->hash & 0xFFFFFFFF, 8) + ".img";
+	CHECK(!readFile(path).empty());
+	ImageCache reader;
+	reader.setDirectory(directory);
+	ImageRef read = reader.get(program.data(), program.size(), 0x0000);
+	CHECK(reader.misses == 1 && read != written);
+	CHECK(read->bytes == written->bytes && read->fusion == written->fusion);
+	CHECK(read->codeMap.imageEnd == written->codeMap.imageEnd && read->codeMap.blocks.size() == written->codeMap.blocks.size());
+	CHECK(read->codeMap.functions == written->codeMap.functions && read->codeMap.code == written->codeMap.code);
+
+	// A damaged file is rebuilt instead of trusted
+	std::ofstream(path, std::ios::binary | std::ios::trunc) << "8080IMG2 truncated";
+	ImageCache rebuilt;
+	rebuilt.setDirectory(directory);
+	ImageRef fresh = rebuilt.get(program.data(), program.size(), 0x0000);
+	CHECK(fresh && fresh->bytes == program && fresh->codeMap.blocks.size() == written->codeMap.blocks.size());
+}
+
+// Superinstructions harvested from one run are applied to the next CPU, unless the page changed
+static void testTranslationCache(const std::string& directory){
+	const char* source = "MVI B, 40H\nloop: DCR B\nJNZ loop\nHLT\n";
+	CPU cpu;
+	cpu.reset();
+	CHECK(assemble(source, cpu).ok);
+	CHECK(cpu.run_for(100000).reason == StopReason::HALTED);
+	CHECK(cpu.fusion[0x0002] == FUSE_DCR_JNZ);
+
+	TranslationCache cache(0x1234);
+	CHECK(!cache.open(directory));
+	CHECK(cache.harvest(cpu));
+	CHECK(!cache.harvest(cpu));
+	CHECK(cache.save());
+	CHECK(!cache.save());
+
+	TranslationCache loaded(0x1234);
+	CHECK(loaded.open(directory));
+	CHECK(!loaded.harvest(cpu));
+	CPU next;
+	next.reset();
+	CHECK(assemble(source, next).ok);
+	CHECK(next.fusion[0x0002] == FUSE_UNDECODED);
+	CHECK(loaded.apply(next) == 1);
+	CHECK(next.fusion[0x0002] == FUSE_DCR_JNZ);
+	CHECK(next.run_for(100000).reason == StopReason::HALTED && next.reg_B == 0);
+
+	// Other bytes on the page: the record is skipped
+	CPU patched;
+	patched.reset();
+	CHECK(assemble("MVI B, 41H\nloop: DCR B\nJNZ loop\nHLT\n", patched).ok);
+	CHECK(loaded.apply(patched) == 0);
+	CHECK(patched.fusion[0x0002] == FUSE_UNDECODED);
+
+	// Another image hash does not open the file
+	TranslationCache other(0x5678);
+	CHECK(!other.open(directory));
+}
+
+int main(){
+	logger().setLevel(LOG_ERROR);
+	char directory[] = "/tmp/tools_test.XXXXXX";
+	if(!mkdtemp(directory)){
+		fprintf(stderr, "could not create a temporary directory\n");
+		return 1;
+	}
+	testAssembleProgram();
+	testDisassemblerRoundTrip();
+	testImageCache(directory);
+	testTranslationCache(directory);
+	std::string command = std::string("rm -rf ") + directory;
+	if(system(command.c_str()) != 0)
+		fprintf(stderr, "could not remove %s\n", directory);
+	return checkResult("tools_test");
+}
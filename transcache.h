@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cpu.h"
+#include "imagecache.h"
+
+// Superinstructions decoded while an image ran, kept on disk so the next process starts with
+// them instead of decoding again. Unlike the image cache this holds whatever the CPU decoded at
+// run time, also code copied to RAM or patched after loading.
+//
+// One file per image hash, one record per 256-byte page. A record only applies when the page
+// (plus the bytes a sequence at its end can reach into) still hashes the same, so stale
+// records are skipped rather than trusted.
+//
+// File layout: TranslationHeader, then recordCount PageTranslation records, native byte order.
+class TranslationCache {
+public:
+	static constexpr uint32_t VERSION = 1;
+
+	struct TranslationHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t fusionCount;		// FUSE_COUNT the kinds were written with
+		uint64_t imageHash;
+		uint32_t recordCount;
+		uint32_t reserved;
+	};
+	struct PageTranslation {
+		uint64_t hash;				// pageHash() of the page the kinds were decoded from
+		uint16_t page;
+		uint8_t reserved[6];
+		uint8_t kinds[0x100];		// Fusion kind per address, FUSE_UNDECODED when unknown
+	};
+
+	explicit TranslationCache(uint64_t imageHash) : imageHash(imageHash) {}
+	TranslationCache(const TranslationCache&) = delete;
+	TranslationCache& operator=(const TranslationCache&) = delete;
+
+	// Maps <directory>/<image hash>.tc if there is a valid one, false otherwise
+	bool open(const std::string& directory){
+		std::lock_guard<std::mutex> lock(mutex);
+		path = directory + "/" + Logger::hexString(imageHash >> 32, 8) + Logger::hexString(imageHash & 0xFFFFFFFF, 8) + ".tc";
+		mapping = Mapping::open(path, imageHash);
+		return mapping != nullptr;
+	}
+
+	// Bytes a page translation depends on: the page and the start of the next one
+	static uint64_t pageHash(const CPU& cpu, int page){
+		uint8_t bytes[0x100 + FUSION_MAX_LENGTH - 1];
+		for(size_t i = 0; i < sizeof(bytes); i++)
+			bytes[i] = cpu.memory[static_cast<uint16_t>((page << 8) + i)];
+		return ::imageHash(bytes, sizeof(bytes), static_cast<uint16_t>(page << 8));
+	}
+
+	// Installs every record that matches the CPU's memory, returns the number of pages used.
+	// Safe to call from several threads at once.
+	size_t apply(CPU& cpu) const {
+		std::shared_ptr<const Mapping> current;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			current = mapping;
+		}
+		if(!current)
+			return 0;
+		size_t used = 0;
+		for(uint32_t i = 0; i < current->header->recordCount; i++){
+			const PageTranslation& record = current->records[i];
+			if(skipPage(cpu, record.page) || pageHash(cpu, record.page) != record.hash)
+				continue;
+			for(int offset = 0; offset < 0x100; offset++){
+				uint16_t address = static_cast<uint16_t>((record.page << 8) + offset);
+				if(record.kinds[offset] != FUSE_UNDECODED && cpu.fusion[address] == FUSE_UNDECODED)
+					cpu.setFusion(address, record.kinds[offset]);
+			}
+			used++;
+		}
+		return used;
+	}
+
+	// Collects the pages decoded during a run, true when it found any that are not on disk yet
+	bool harvest(const CPU& cpu){
+		std::lock_guard<std::mutex> lock(mutex);
+		bool added = false;
+		for(int page = 0; page < 0x100; page++){
+			if(!cpu.fusionPages[page] || skipPage(cpu, page))
+				continue;
+			PageTranslation record = {};
+			record.hash = pageHash(cpu, page);
+			record.page = static_cast<uint16_t>(page);
+			memcpy(record.kinds, &cpu.fusion[page << 8], sizeof(record.kinds));
+			if(merge(record))
+				added = true;
+		}
+		return added;
+	}
+
+	// Writes the mapped and harvested records to a new file and maps that one instead
+	bool save(){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(path.empty() || pending.empty())
+			return false;
+		std::map<std::pair<uint16_t, uint64_t>, PageTranslation> records;
+		if(mapping)
+			for(uint32_t i = 0; i < mapping->header->recordCount; i++)
+				records[{mapping->records[i].page, mapping->records[i].hash}] = mapping->records[i];
+		for(const auto& entry : pending)
+			records[entry.first] = entry.second;
+
+		TranslationHeader header = {};
+		memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version = VERSION;
+		header.fusionCount = FUSE_COUNT;
+		header.imageHash = imageHash;
+		header.recordCount = static_cast<uint32_t>(records.size());
+
+		// Written under a temporary name, processes that mapped the old file keep their copy
+		std::string temporary = path + ".tmp";
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if(!file)
+			return false;
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+		for(const auto& entry : records)
+			written = written && fwrite(&entry.second, sizeof(PageTranslation), 1, file) == 1;
+		written = fclose(file) == 0 && written;
+		if(!written || rename(temporary.c_str(), path.c_str()) != 0){
+			remove(temporary.c_str());
+			return false;
+		}
+		pending.clear();
+		mapping = Mapping::open(path, imageHash);
+		return true;
+	}
+
+private:
+	static constexpr char MAGIC[8] = {'8', '0', '8', '0', 'T', 'C', 'A', 'C'};
+
+	// Read-only view of one cache file, unmapped when the last user lets go
+	struct Mapping {
+		const TranslationHeader* header = nullptr;
+		const PageTranslation* records = nullptr;
+		size_t length = 0;
+
+		~Mapping(){
+			if(header)
+				munmap(const_cast<TranslationHeader*>(header), length);
+		}
+
+		static std::shared_ptr<const Mapping> open(const std::string& path, uint64_t imageHash){
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if(fd < 0)
+				return nullptr;
+			struct stat info;
+			if(fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(TranslationHeader))){
+				::close(fd);
+				return nullptr;
+			}
+			void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if(mapped == MAP_FAILED)
+				return nullptr;
+
+			auto mapping = std::make_shared<Mapping>();
+			mapping->header = static_cast<const TranslationHeader*>(mapped);
+			mapping->records = reinterpret_cast<const PageTranslation*>(mapping->header + 1);
+			mapping->length = info.st_size;
+			const TranslationHeader& header = *mapping->header;
+			if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.fusionCount != FUSE_COUNT
+			   || header.imageHash != imageHash
+			   || info.st_size != static_cast<off_t>(sizeof(TranslationHeader) + header.recordCount * sizeof(PageTranslation)))
+				return nullptr;
+			for(uint32_t i = 0; i < header.recordCount; i++){
+				if(mapping->records[i].page > 0xFF)
+					return nullptr;
+				for(uint8_t kind : mapping->records[i].kinds)
+					if(kind >= FUSE_COUNT)
+						return nullptr;
+			}
+			return mapping;
+		}
+	};
+
+	uint64_t imageHash;
+	std::string path;
+	std::shared_ptr<const Mapping> mapping;
+	std::map<std::pair<uint16_t, uint64_t>, PageTranslation> pending;	// by page and page hash
+	mutable std::mutex mutex;
+
+	// fetch() reads banked pages from the bank store, not from memory
+	static bool skipPage(const CPU& cpu, int page){
+		return cpu.pageFlags[page] & PAGE_BANKED;
+	}
+
+	// Adds a harvested record unless the file or an earlier harvest already has all of it
+	bool merge(PageTranslation& record){
+		std::pair<uint16_t, uint64_t> key = {record.page, record.hash};
+		const PageTranslation* known = nullptr;
+		auto waiting = pending.find(key);
+		if(waiting != pending.end())
+			known = &waiting->second;
+		else if(mapping)
+			for(uint32_t i = 0; i < mapping->header->recordCount && !known; i++)
+				if(mapping->records[i].page == record.page && mapping->records[i].hash == record.hash)
+					known = &mapping->records[i];
+
+		bool added = !known;
+		for(int offset = 0; known && offset < 0x100; offset++){
+			if(record.kinds[offset] == FUSE_UNDECODED)
+				record.kinds[offset] = known->kinds[offset];
+			else if(known->kinds[offset] == FUSE_UNDECODED)
+				added = true;
+		}
+		if(added)
+			pending[key] = record;
+		return added;
+	}
+};